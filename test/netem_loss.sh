@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+# Measures how many copies of each magic packet get through a lossy link.
+#
+# Applies `tc netem loss` on lo, wakes a few macs with --repeat over udp,
+# and compares the per-mac totals `wol listen` reports with the expected
+# 1 - loss ratio. Needs root and the sch_netem module.
+#
+#   test/netem_loss.sh [wol binary] [loss %] [repeat] [tolerance %]
+#   test/netem_loss.sh ./wol 20 2000 3
+
+set -u
+
+WOL=${1:-./wol}
+LOSS=${2:-20}
+REPEAT=${3:-2000}
+TOLERANCE=${4:-3}
+GAP_US=100
+MACS="02:00:00:00:00:01 02:00:00:00:00:02 02:00:00:00:00:03"
+LOG=$(mktemp)
+
+listen_pid=
+netem_added=
+cleanup()
+{
+    [ -n "$listen_pid" ] && kill -INT "$listen_pid" 2>/dev/null
+    # only remove the qdisc this script added, never one lo already had
+    [ -n "$netem_added" ] && tc qdisc del dev lo root 2>/dev/null
+    rm -f "$LOG"
+}
+trap cleanup EXIT
+
+if [ "$LOSS" != 0 ]; then
+    if ! tc qdisc add dev lo root netem loss "${LOSS}%"; then
+        echo "cannot apply netem on lo, is sch_netem available and lo without a root qdisc?"
+        exit 2
+    fi
+    netem_added=1
+fi
+
+"$WOL" listen -i lo > "$LOG" 2>&1 &
+listen_pid=$!
+sleep 1
+
+# shellcheck disable=SC2086
+if ! "$WOL" wake $MACS -i lo -b 127.255.255.255 --repeat "$REPEAT" --gap "$GAP_US" > /dev/null; then
+    echo "wol wake failed"
+    exit 1
+fi
+sleep 1
+
+kill -INT "$listen_pid"
+wait "$listen_pid"
+listen_pid=
+
+failed=0
+for mac in $MACS; do
+    total=$(sed -n '/^summary:/,$p' "$LOG" | awk -v mac="$mac" '$1 == mac { print $4 }')
+    total=${total:-0}
+    ratio=$(awk -v t="$total" -v r="$REPEAT" 'BEGIN { printf "%.2f", t * 100 / r }')
+    result=ok
+    if ! awk -v ratio="$ratio" -v loss="$LOSS" -v tol="$TOLERANCE" \
+        'BEGIN { d = ratio - (100 - loss); exit !(d <= tol && d >= -tol) }'; then
+        result=FAILED
+        failed=1
+    fi
+    printf "%s    delivered: %s/%s    %s%%, expected %s%% +-%s%%    %s\n" \
+        "$mac" "$total" "$REPEAT" "$ratio" "$((100 - LOSS))" "$TOLERANCE" "$result"
+done
+
+exit $failed
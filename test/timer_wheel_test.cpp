@@ -0,0 +1,75 @@
+// Checks timer_wheel against the wake times schedule run needs.
+//
+//   g++ -std=c++11 -pthread test/timer_wheel_test.cpp -o timer_wheel_test && ./timer_wheel_test
+//
+// Drives the wheel the way run_schedules does: sleep for next_timeout(),
+// then advance() to the new time, and reports every entry that fires late.
+
+#define main wol_main
+#include "../wol.cpp"
+#undef main
+
+static bool check_fire_times(const std::vector<uint64_t> &expire_vec, const uint64_t start_ms)
+{
+    timer_wheel wheel(start_ms);
+    for (uint32_t id = 0; id < expire_vec.size(); ++id)
+    {
+        wheel.add(expire_vec[id], id);
+    }
+
+    bool ok = true;
+    uint64_t now = start_ms;
+    std::vector<uint32_t> expired;
+    while (wheel.size() != 0)
+    {
+        expired.clear();
+        wheel.advance(now, expired);
+        for (auto id : expired)
+        {
+            if (now != std::max(expire_vec[id], start_ms))
+            {
+                fprintf(stderr, "entry due at %llu fired at %llu\n",
+                        static_cast<unsigned long long>(expire_vec[id]),
+                        static_cast<unsigned long long>(now));
+                ok = false;
+            }
+        }
+        now += std::max<uint64_t>(wheel.next_timeout(now, 60 * 1000), 1);
+    }
+    return ok;
+}
+
+int main()
+{
+    constexpr uint64_t kWrap = 256 * 1000;
+
+    std::vector<std::vector<uint64_t>> case_vec = {
+        // the level 0 wheel wraps right after the first entry fires
+        {kWrap - 1, kWrap + 5},
+        {kWrap - 1, kWrap},
+        {kWrap - 1, kWrap + 255, kWrap + 256, kWrap + 300},
+        // the level 1 wheel wraps as well
+        {256 * 256 * 4 - 1, 256 * 256 * 4 + 7},
+        // already due, and far out
+        {kWrap - 100, kWrap + 1000000, kWrap + 123456789},
+    };
+
+    bool ok = true;
+    for (auto &expire_vec : case_vec)
+    {
+        ok = check_fire_times(expire_vec, expire_vec[0] - 10) && ok;
+    }
+    ok = check_fire_times({kWrap - 100}, kWrap) && ok;
+
+    // random due times around many wraps
+    srand(1);
+    std::vector<uint64_t> expire_vec;
+    for (int i = 0; i < 10000; ++i)
+    {
+        expire_vec.emplace_back(kWrap + rand() % (256 * 256 * 8));
+    }
+    ok = check_fire_times(expire_vec, kWrap - 3) && ok;
+
+    printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
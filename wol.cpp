@@ -1,41 +1,95 @@
 #include <sys/types.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <netinet/ether.h>
+#include <netinet/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <net/if_arp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <netdb.h>
 #include <ifaddrs.h>  
+#include <linux/if_packet.h>
+#include <poll.h>
+#include <signal.h>
 #include <pwd.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <string>
+#include <system_error>
 #include <regex>
 #include <vector>
 #include <sstream>
 
 static const std::string s_reg_str = "^([0-9A-Fa-f]{2}[:-]){5}([0-9A-Fa-f]{2})$";
 static std::string s_stores_file_path;
+static std::string s_schedule_file_path;
+static std::string s_ip_file_path;
 
 static void print_usage();
 static void list_aliases();
 static bool remove_alias(const std::string &alias);
-static bool stores_alias(const std::string &alias, const std::string &mac);
+static bool stores_alias(const std::string &alias, const std::string &mac, const std::string &ip);
+static bool stores_alias_ip(const std::string &alias, const std::string &ip);
+static std::string ip_to_str(const uint32_t ip);
+static uint64_t mac_str_to_u64(const std::string &mac_addr);
+static bool resolve_unicast_ips(const std::map<std::string, std::string> &mac_addr_map,
+                                const std::vector<std::string> &target_alias_vec,
+                                const std::vector<std::string> &mac_addr_vec,
+                                std::vector<uint32_t> &dst_ip_vec);
+static bool send_unicast(const std::string &interface,
+                         const bool keep_neigh,
+                         const std::vector<std::string> &mac_addr_vec,
+                         const std::vector<uint32_t> &dst_ip_vec,
+                         const std::vector<std::vector<unsigned char>> &packet_vec,
+                         const std::vector<uint16_t> &port_vec,
+                         const uint32_t repeat,
+                         const uint32_t gap_us);
 static bool send_wol(std::map<std::string, std::string> &cmd_map, std::vector<std::string> &wake_machine_vec);
+static bool send_magic_packets(const std::map<std::string, std::string> &cmd_map,
+                               const std::map<std::string, std::string> &mac_addr_map,
+                               const std::vector<std::string> &mac_addr_vec,
+                               const std::vector<std::string> &target_alias_vec);
 static std::vector<std::string> split(const std::string &s, char delim);
 static std::map<std::string, std::string> parse_mac_addr(const std::string &new_data);
 static std::string mac_addr_to_str(const std::map<std::string, std::string> &mac_map);
+static bool handle_schedule(int argc, char **argv);
+static bool run_schedules(const std::map<std::string, std::string> &cmd_map);
+static bool listen_wol(const std::map<std::string, std::string> &cmd_map);
+static bool discover_aliases(std::map<std::string, std::string> &cmd_map, int argc, char **argv);
 
 constexpr uint32_t kMACSize = 17;
 constexpr uint32_t kAliasSize = sizeof(uint16_t);
 constexpr uint32_t kHeadSize = kMACSize + kAliasSize;
+constexpr uint16_t kEtherTypeWol = 0x0842;
+constexpr uint32_t kMagicDataSize = 102;
+constexpr std::size_t kPcapBufferSize = 1 << 20;
+constexpr std::size_t kPcapMapChunkSize = 64 << 20;
 /*
    17 byte     2 byte    variable len   
  ______________________________________
@@ -45,6 +99,92 @@ constexpr uint32_t kHeadSize = kMACSize + kAliasSize;
 
 */
 
+constexpr uint32_t kIPSize = sizeof(uint32_t);
+constexpr uint32_t kIPHeadSize = kIPSize + kAliasSize;
+/*
+   4 byte     2 byte     variable len
+ _____________________________________
+|          |           |              |
+| ipv4 addr| alias len |  alias name  |
+|__________|___________|______________|
+
+   the last known ip of an alias, kept in its own file so wol.db stays as is
+*/
+
+constexpr uint32_t kScheduleHeadSize = sizeof(uint64_t) * 2;
+/*
+   8 byte      8 byte     2 byte       variable      2 byte      variable
+ ___________________________________________________________________________
+|          |          |            |             |            |             |
+| first ms | every ms | target len | target name |  name len  |  sched name |
+|__________|__________|____________|_____________|____________|_____________|
+
+   first ms is the unix time (in ms) of the first wake, every ms is 0 for a
+   one-shot wake, otherwise the wake repeats every `every ms` after first ms.
+*/
+
+struct neigh_entry
+{
+    int ifindex = 0;
+    uint16_t state = 0; // NUD_*
+    uint32_t ip = 0;    // network byte order
+    std::string mac;    // empty while the kernel has no lladdr
+};
+
+struct schedule_entry
+{
+    uint64_t first_ms = 0;
+    uint64_t every_ms = 0;
+    std::string target;
+};
+
+/*
+   hierarchical timer wheel with 1ms ticks, five levels of 256 slots cover
+   2^40 ms, entries in the upper levels are cascaded down as the wheel turns,
+   so add and expire are O(1) no matter how many entries are pending.
+*/
+class timer_wheel
+{
+public:
+    explicit timer_wheel(const uint64_t now_ms) : base_ms_(now_ms) {}
+
+    void add(const uint64_t expire_ms, const uint32_t id);
+
+    // collects the ids of all entries expiring up to and including now_ms
+    void advance(const uint64_t now_ms, std::vector<uint32_t> &expired);
+
+    // ms to sleep before the next call to advance() could expire something
+    uint64_t next_timeout(const uint64_t now_ms, const uint64_t max_ms) const;
+
+    uint64_t base_ms() const
+    {
+        return base_ms_;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+private:
+    static constexpr uint32_t kLevels = 5;
+    static constexpr uint32_t kSlotBits = 8;
+    static constexpr uint32_t kSlots = 1 << kSlotBits;
+    static constexpr uint64_t kSlotMask = kSlots - 1;
+
+    struct entry
+    {
+        uint64_t expire_ms;
+        uint32_t id;
+    };
+
+    void cascade(const uint32_t level);
+
+    std::vector<entry> slots_[kLevels][kSlots];
+    uint64_t base_ms_ = 0;
+    std::size_t size_ = 0;
+};
+
 class file_helper
 {
 private:
@@ -78,6 +218,42 @@ private:
     std::string file_name_;
 };
 
+/*
+   writes ethernet frames to a pcap file, through a 1MB buffer by default or,
+   with use_mmap, straight into a shared file mapping grown 64MB at a time
+*/
+class pcap_writer
+{
+public:
+    pcap_writer() = default;
+    ~pcap_writer();
+
+    bool open(const std::string &file_name, const bool use_mmap);
+
+    bool write(const uint64_t ts_us, const unsigned char *frame, const uint32_t frame_size);
+
+    bool close();
+
+    uint64_t frames() const
+    {
+        return frames_;
+    }
+
+private:
+    bool flush();
+
+    bool remap(const std::size_t need_size);
+
+    file_helper file_;
+    bool use_mmap_ = false;
+    bool closed_ = true;
+    std::string buffer_;
+    char *map_data_ = nullptr;
+    std::size_t map_size_ = 0;
+    std::size_t map_pos_ = 0;
+    uint64_t frames_ = 0;
+};
+
 struct do_on_exit
 {
     do_on_exit(std::function<void(void)> hd) : do_on_exit_hd_(hd) {}
@@ -104,6 +280,10 @@ int main(int argc, char **argv)
 
     s_stores_file_path = pwd->pw_dir;
     s_stores_file_path.append("/.config/wol.db");
+    s_schedule_file_path = pwd->pw_dir;
+    s_schedule_file_path.append("/.config/wol.schedule.db");
+    s_ip_file_path = pwd->pw_dir;
+    s_ip_file_path.append("/.config/wol.ip.db");
 
     std::regex reg("^(-{0,2})(.+)$");
     std::vector<std::string> wake_machine_vec; 
@@ -167,6 +347,54 @@ int main(int argc, char **argv)
                     exit(1);
                 }
             }
+            else if (cmd == "r" || cmd == "repeat")
+            {
+                if (i + 1 < argc)
+                {
+                    cmd_map.emplace("repeat", argv[i+1]);
+                    i += 2;
+                    continue;
+                }
+                else 
+                {
+                    fprintf(stderr, "option %s required parameters\n", cmd.c_str());
+                    exit(1);
+                }
+            }
+            else if (cmd == "g" || cmd == "gap")
+            {
+                if (i + 1 < argc)
+                {
+                    cmd_map.emplace("gap", argv[i+1]);
+                    i += 2;
+                    continue;
+                }
+                else 
+                {
+                    fprintf(stderr, "option %s required parameters\n", cmd.c_str());
+                    exit(1);
+                }
+            }
+            else if (cmd == "pcap")
+            {
+                if (i + 1 < argc)
+                {
+                    cmd_map.emplace("pcap", argv[i+1]);
+                    i += 2;
+                    continue;
+                }
+                else 
+                {
+                    fprintf(stderr, "option %s required parameters\n", cmd.c_str());
+                    exit(1);
+                }
+            }
+            else if (cmd == "mmap" || cmd == "raw")
+            {
+                cmd_map.emplace(cmd, "");
+                ++i;
+                continue;
+            }
             else if (cmd == "list")
             {
                 list_aliases();
@@ -188,7 +416,19 @@ int main(int argc, char **argv)
             {
                 if (i + 2 < argc)
                 {
-                    stores_alias(argv[i+1], argv[i+2]) ? exit(0) : exit(1);
+                    stores_alias(argv[i+1], argv[i+2], i + 3 < argc ? argv[i+3] : "") ? exit(0) : exit(1);
+                }
+                else 
+                {
+                    fprintf(stderr, "option %s required two parameters\n", cmd.c_str());
+                    exit(1);
+                }
+            }
+            else if (cmd == "ip")
+            {
+                if (i + 2 < argc)
+                {
+                    stores_alias_ip(argv[i+1], argv[i+2]) ? exit(0) : exit(1);
                 }
                 else 
                 {
@@ -196,6 +436,40 @@ int main(int argc, char **argv)
                     exit(1);
                 }
             }
+            else if (cmd == "u" || cmd == "unicast" || cmd == "keep-neigh")
+            {
+                cmd_map.emplace(cmd == "u" ? "unicast" : cmd, "");
+                ++i;
+                continue;
+            }
+            else if (cmd == "schedule")
+            {
+                if (i + 1 < argc && strcmp(argv[i+1], "run") == 0)
+                {
+                    cmd_map.emplace("schedule", argv[i+1]);
+                    i += 2;
+                    continue;
+                }
+                else if (i + 1 < argc)
+                {
+                    handle_schedule(argc - i - 1, argv + i + 1) ? exit(0) : exit(1);
+                }
+                else
+                {
+                    fprintf(stderr, "option %s required parameters\n", cmd.c_str());
+                    exit(1);
+                }
+            }
+            else if (cmd == "discover")
+            {
+                discover_aliases(cmd_map, argc - i - 1, argv + i + 1) ? exit(0) : exit(1);
+            }
+            else if (cmd == "listen")
+            {
+                cmd_map.emplace("listen", "");
+                ++i;
+                continue;
+            }
             else if (cmd == "wake")
             {
                 if (i + 1 < argc)
@@ -215,6 +489,16 @@ int main(int argc, char **argv)
             ++i;
         }
 
+        if (cmd_map.count("listen") != 0)
+        {
+            listen_wol(cmd_map) ? exit(0) : exit(1);
+        }
+
+        if (cmd_map.count("schedule") != 0)
+        {
+            run_schedules(cmd_map) ? exit(0) : exit(1);
+        }
+
         send_wol(cmd_map, wake_machine_vec) ? exit(0) : exit(1);
         
     }
@@ -246,8 +530,9 @@ static void print_usage()
     "       wol wake <mac address | alias> <optional ...>\n"
     "       wol <mac address | alias> <optional ...>\n"
     "\n"
-    "   To store an alias:\n"
-    "       wol alias <alias> <mac address>\n"
+    "   To store an alias, optionally with the last known ip of the machine:\n"
+    "       wol alias <alias> <mac address> [ip]\n"
+    "       wol ip <alias> <ip>\n"
     "\n"
     "   To view aliases:\n"
     "        wol list\n"
@@ -255,6 +540,22 @@ static void print_usage()
     "   To delete aliases:\n"
     "       wol remove <alias>\n"
     "\n"
+    "   To schedule a wake, once or repeating every <interval>:\n"
+    "       wol schedule add <name> <mac address | alias> <time> [interval]\n"
+    "       wol schedule list\n"
+    "       wol schedule remove <name>\n"
+    "       wol schedule run <optional ...>\n"
+    "\n"
+    "   To store aliases for the machines in the neighbor (arp) table, optionally\n"
+    "   probing every host of a subnet first:\n"
+    "       wol discover [subnet/prefix] [-n --numeric] <optional ...>\n"
+    "\n"
+    "   To watch magic packets arriving on udp ports 7, 9 and ethertype 0x0842:\n"
+    "       wol listen <optional ...>\n"
+    "\n"
+    "   <time> is +<interval>, HH:MM[:SS] or YYYY-MM-DDTHH:MM[:SS] (local time),\n"
+    "   <interval> is a number followed by ms, s, m, h or d, e.g. 500ms, 24h\n"
+    "\n"
     "   The following MAC addresses are valid and will match:\n"
     "   01-23-45-56-67-89, 89:AB:CD:EF:00:12, 89:ab:cd:ef:00:12\n"
     "\n"
@@ -265,14 +566,26 @@ static void print_usage()
     "   wake               wakes up a machine by mac address or alias\n"
     "   list               lists all mac addresses and their aliases\n"
     "   alias              stores an alias to a mac address\n"
+    "   ip                 stores the last known ip of an alias\n"
     "   remove             removes an alias or a mac address\n"
+    "   schedule           adds, lists, removes or runs scheduled wakes\n"
+    "   discover           stores aliases for machines in the neighbor table\n"
+    "   listen             counts received magic packets per mac address\n"
     "\n"
     "\n"
     "Options:\n"
     "   -h --help          prints this help menu\n"
-    "   -p --port          udp port to send bcast packet to\n"
+    "   -p --port          udp port to send bcast packet to, e.g. 9 or 7,9\n"
     "   -b --bcast         broadcast IP to send packet to\n"
-    "   -i --interface     outbound interface to broadcast using\n";
+    "   -i --interface     outbound interface to broadcast using\n"
+    "   -r --repeat        copies of each packet to send, 1 to 1000000, default 1\n"
+    "   -g --gap           microseconds between copies of the same packet, up to 60s\n"
+    "   --raw              send ethertype 0x0842 frames instead of udp\n"
+    "   --pcap             write the frames to a pcap file instead of sending\n"
+    "   --mmap             write the pcap file through mmap\n"
+    "   -u --unicast       send to the last known ip of each machine instead of\n"
+    "                      broadcasting, with a neighbor entry for its mac\n"
+    "   --keep-neigh       keep the neighbor entries added by --unicast\n";
     
     printf("%s\n", usage);
 }
@@ -334,6 +647,78 @@ static std::string mac_addr_to_str(const std::map<std::string, std::string> &mac
     return data_str;
 }
 
+static std::map<std::string, uint32_t> parse_alias_ip(const std::string &data)
+{
+    std::size_t pos = 0;
+    std::size_t data_size = data.size();
+
+    std::map<std::string, uint32_t> alias_ip_map;
+    while (data_size - pos > kIPHeadSize)
+    {
+        uint16_t alias_size = 0;
+        memcpy(&alias_size, &data[pos + kIPSize], kAliasSize);
+        if (alias_size == 0 
+            || (data_size - pos) < (kIPHeadSize + alias_size))
+        {
+            fprintf(stderr, "ip file: %s invalid, please remove it\n", s_ip_file_path.c_str());
+            exit(1);
+        }
+
+        uint32_t ip = 0;
+        memcpy(&ip, &data[pos], kIPSize);
+        alias_ip_map.emplace(data.substr(pos + kIPHeadSize, alias_size), ip);
+        pos += kIPHeadSize + alias_size;
+    }
+
+    return alias_ip_map;
+}
+
+static std::string alias_ip_to_str(const std::map<std::string, uint32_t> &alias_ip_map)
+{
+    std::string data_str;
+    std::size_t total_size = 0;
+    for (auto &item : alias_ip_map)
+    {
+        total_size += item.first.size();
+        total_size += kIPHeadSize;
+    }
+
+    if (total_size == 0)
+    {
+        return data_str;
+    }
+
+    data_str.resize(total_size);
+    std::size_t pos = 0;
+    for (auto &item : alias_ip_map)
+    {
+        memcpy(&data_str[pos], &item.second, kIPSize);
+        pos += kIPSize;
+        uint16_t alias_size = item.first.size();
+        memcpy(&data_str[pos], &alias_size, kAliasSize);
+        pos += kAliasSize;
+        memcpy(&data_str[pos], &item.first[0], alias_size);
+        pos += alias_size;
+    }
+
+    return data_str;
+}
+
+static bool read_alias_ips(file_helper &file, std::map<std::string, uint32_t> &alias_ip_map)
+{
+    if (!file.open(s_ip_file_path, O_RDONLY | O_CREAT))
+    {
+        return false;
+    }
+    std::string data;
+    if (!file.read(data))
+    {
+        return false;
+    }
+    alias_ip_map = parse_alias_ip(data);
+    return true;
+}
+
 static void list_aliases()
 {
     file_helper file;
@@ -347,12 +732,26 @@ static void list_aliases()
         exit(1);
     }
     auto mac_addr_map = parse_mac_addr(data);
+    file_helper ip_file;
+    std::map<std::string, uint32_t> alias_ip_map;
+    if (!read_alias_ips(ip_file, alias_ip_map))
+    {
+        exit(1);
+    }
     if (!mac_addr_map.empty())
     {
         printf("all aliases:\n");
         for (auto &item : mac_addr_map)
         {
-            printf("    %s    %s\n", item.second.c_str(), item.first.c_str());
+            auto ip_it = alias_ip_map.find(item.first);
+            if (ip_it != alias_ip_map.end())
+            {
+                printf("    %s    %s    %s\n", item.second.c_str(), item.first.c_str(), ip_to_str(ip_it->second).c_str());
+            }
+            else
+            {
+                printf("    %s    %s\n", item.second.c_str(), item.first.c_str());
+            }
         }
     }
     else
@@ -386,6 +785,12 @@ static bool remove_alias(const std::string &alias)
     auto new_data = mac_addr_to_str(mac_addr_map);
     if (file.write_truncate_atomic(new_data))
     {
+        file_helper ip_file;
+        std::map<std::string, uint32_t> alias_ip_map;
+        if (read_alias_ips(ip_file, alias_ip_map) && alias_ip_map.erase(alias) != 0)
+        {
+            ip_file.write_truncate_atomic(alias_ip_to_str(alias_ip_map));
+        }
         printf("remove alias: %s %s ok\n", alias.c_str(), mac_addr.c_str());
         return true;
     }
@@ -396,7 +801,7 @@ static bool remove_alias(const std::string &alias)
     }
 }
 
-static bool stores_alias(const std::string &alias, const std::string &mac)
+static bool stores_alias(const std::string &alias, const std::string &mac, const std::string &ip)
 {
     std::regex reg(s_reg_str);
     if (!std::regex_match(mac, reg))
@@ -404,6 +809,12 @@ static bool stores_alias(const std::string &alias, const std::string &mac)
         fprintf(stderr, "invalid mac addr：%s failed\n", mac.c_str());
         return false;
     }
+    struct in_addr ip_addr;
+    if (!ip.empty() && inet_aton(ip.c_str(), &ip_addr) == 0)
+    {
+        fprintf(stderr, "invalid ip addr：%s\n", ip.c_str());
+        return false;
+    }
 
     file_helper file;
     if (!file.open(s_stores_file_path, O_RDONLY | O_CREAT))
@@ -428,7 +839,7 @@ static bool stores_alias(const std::string &alias, const std::string &mac)
     if (file.write_truncate_atomic(new_data))
     {
         printf("stores alias %s %s ok\n", alias.c_str(), mac.c_str());
-        return true;
+        return ip.empty() || stores_alias_ip(alias, ip);
     }
     else
     {
@@ -437,6 +848,44 @@ static bool stores_alias(const std::string &alias, const std::string &mac)
     }
 }
 
+static bool stores_alias_ip(const std::string &alias, const std::string &ip)
+{
+    struct in_addr ip_addr;
+    if (inet_aton(ip.c_str(), &ip_addr) == 0)
+    {
+        fprintf(stderr, "invalid ip addr：%s\n", ip.c_str());
+        return false;
+    }
+
+    file_helper file;
+    std::string data;
+    if (!file.open(s_stores_file_path, O_RDONLY | O_CREAT) || !file.read(data))
+    {
+        exit(1);
+    }
+    if (parse_mac_addr(data).count(alias) == 0)
+    {
+        fprintf(stderr, "alias: %s no found\n", alias.c_str());
+        return false;
+    }
+
+    file_helper ip_file;
+    std::map<std::string, uint32_t> alias_ip_map;
+    if (!read_alias_ips(ip_file, alias_ip_map))
+    {
+        exit(1);
+    }
+    alias_ip_map[alias] = ip_addr.s_addr;
+    if (!ip_file.write_truncate_atomic(alias_ip_to_str(alias_ip_map)))
+    {
+        fprintf(stderr, "stores alias ip failed\n");
+        return false;
+    }
+
+    printf("stores alias %s ip %s ok\n", alias.c_str(), ip_to_str(ip_addr.s_addr).c_str());
+    return true;
+}
+
 static std::vector<unsigned char> package_magic_data(const std::string &mac_addr)
 {
     std::vector<unsigned char> package_data;
@@ -486,128 +935,2410 @@ static std::set<std::string> get_interfaces()
     return interfaces_name_set;
 }
 
-static bool send_wol(std::map<std::string, std::string> &cmd_map, std::vector<std::string> &wake_machine_vec)
+static uint16_t ip_checksum(const unsigned char *data, const std::size_t size)
 {
-    std::string bcast_addr = "255.255.255.255";
-    uint16_t port = 9;
-    std::set<std::string> interface_set;
-
-    auto it = cmd_map.find("bcast");
-    if (it != cmd_map.end())
+    uint32_t sum = 0;
+    for (std::size_t i = 0; i + 1 < size; i += 2)
     {
-        bcast_addr = it->second;
+        sum += (data[i] << 8) | data[i + 1];
     }
-    it = cmd_map.find("port");
-    if (it != cmd_map.end())
+    if (size & 1)
     {
-        port = std::stoi(it->second);
+        sum += data[size - 1] << 8;
     }
-    it = cmd_map.find("interface");
-    if (it != cmd_map.end())
+    while (sum >> 16)
     {
-        interface_set.emplace(it->second);
+        sum = (sum & 0xffff) + (sum >> 16);
     }
+    return htons(~sum & 0xffff);
+}
 
-    if (interface_set.empty())
+// the frame the kernel would put on the wire, with the source mac, ip and port
+// left zeroed since the kernel picks them, unicast frames go to the mac address
+// the magic packet wakes
+static std::vector<unsigned char> build_udp_frame(const std::vector<unsigned char> &packet,
+                                                  const uint32_t dst_ip,
+                                                  const uint16_t port,
+                                                  const bool unicast)
+{
+    std::vector<unsigned char> frame(sizeof(struct ether_header) + sizeof(struct iphdr) + sizeof(struct udphdr) + packet.size());
+
+    auto eth = (struct ether_header *)&frame[0];
+    if (unicast)
     {
-        interface_set = get_interfaces();
-        if (interface_set.empty())
+        memcpy(eth->ether_dhost, &packet[6], ETH_ALEN);
+    }
+    else
+    {
+        memset(eth->ether_dhost, 0xff, ETH_ALEN);
+    }
+    eth->ether_type = htons(ETHERTYPE_IP);
+
+    auto ip = (struct iphdr *)&frame[sizeof(struct ether_header)];
+    ip->version = 4;
+    ip->ihl = sizeof(struct iphdr) / 4;
+    ip->tot_len = htons(frame.size() - sizeof(struct ether_header));
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->daddr = dst_ip;
+    ip->check = ip_checksum((const unsigned char *)ip, sizeof(struct iphdr));
+
+    auto udp = (struct udphdr *)&frame[sizeof(struct ether_header) + sizeof(struct iphdr)];
+    udp->dest = htons(port);
+    udp->len = htons(sizeof(struct udphdr) + packet.size());
+
+    memcpy(udp + 1, &packet[0], packet.size());
+    return frame;
+}
+
+static std::vector<unsigned char> build_ether_frame(const std::vector<unsigned char> &packet)
+{
+    std::vector<unsigned char> frame(sizeof(struct ether_header) + packet.size());
+
+    auto eth = (struct ether_header *)&frame[0];
+    memset(eth->ether_dhost, 0xff, ETH_ALEN);
+    eth->ether_type = htons(kEtherTypeWol);
+
+    memcpy(eth + 1, &packet[0], packet.size());
+    return frame;
+}
+
+/*
+   writes the frames send_wol would send, in the same order, timestamps start
+   at 0 and advance by gap_us per round so the output is reproducible. the file
+   has no interface dimension, every frame is written once per round however
+   many interfaces send_wol would send it on. the reported rate counts from
+   start_ts, taken before the magic packets were built
+*/
+static bool write_pcap(const std::string &file_name,
+                       const bool use_mmap,
+                       const bool raw,
+                       const bool unicast,
+                       const std::vector<uint32_t> &dst_ip_vec,
+                       const std::vector<std::vector<unsigned char>> &packet_vec,
+                       const std::vector<uint16_t> &port_vec,
+                       const uint32_t repeat,
+                       const uint32_t gap_us,
+                       const struct timespec &start_ts)
+{
+    std::vector<std::vector<unsigned char>> frame_vec;
+    for (std::size_t index = 0; index < packet_vec.size(); ++index)
+    {
+        if (raw)
         {
-            fprintf(stderr, "get network interfaces failed, errno:%d, dsec:%s\n", errno, strerror(errno));
-            return false;
+            frame_vec.emplace_back(build_ether_frame(packet_vec[index]));
+            continue;
+        }
+        for (auto port : port_vec)
+        {
+            frame_vec.emplace_back(build_udp_frame(packet_vec[index], dst_ip_vec[index], port, unicast));
         }
     }
 
-    file_helper file;
-    std::string data;
-    if (!file.open(s_stores_file_path, O_RDONLY | O_CREAT))
+    pcap_writer writer;
+    if (!writer.open(file_name, use_mmap))
     {
-        fprintf(stderr, "open stores file faile\n");
+        return false;
+    }
+
+    for (uint32_t round = 0; round < repeat; ++round)
+    {
+        uint64_t ts_us = static_cast<uint64_t>(round) * gap_us;
+        for (auto &frame : frame_vec)
+        {
+            if (!writer.write(ts_us, &frame[0], frame.size()))
+            {
+                return false;
+            }
+        }
+    }
+    if (!writer.close())
+    {
+        return false;
+    }
+
+    struct timespec end_ts;
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    auto elapsed_us = std::max<uint64_t>((end_ts.tv_sec - start_ts.tv_sec) * 1000000 + (end_ts.tv_nsec - start_ts.tv_nsec) / 1000, 1);
+    printf("Successful wrote %llu WOL frames to: %s in %llums, %.0f frames/s\n",
+           static_cast<unsigned long long>(writer.frames()),
+           file_name.c_str(),
+           static_cast<unsigned long long>(elapsed_us / 1000),
+           writer.frames() * 1000000.0 / elapsed_us);
+    return true;
+}
+
+static bool send_wol(std::map<std::string, std::string> &cmd_map, std::vector<std::string> &wake_machine_vec)
+{
+    file_helper file;
+    std::string data;
+    if (!file.open(s_stores_file_path, O_RDONLY | O_CREAT))
+    {
+        fprintf(stderr, "open stores file faile\n");
         return false;
     }
     else 
     {
-        if (!file.read(data))
+        if (!file.read(data))
+        {
+            fprintf(stderr, "read open stores file failed\n");
+            return false;
+        }
+    }
+
+    auto mac_addr_map = parse_mac_addr(data);
+    auto it = cmd_map.find("wake");
+    if (it != cmd_map.end())
+    {
+        wake_machine_vec.emplace_back(it->second);
+    }
+
+    std::vector<std::string> mac_addr_vec;
+    std::vector<std::string> target_alias_vec;
+    std::regex reg(s_reg_str);
+    for (auto &mac_addr : wake_machine_vec)
+    {
+        if (std::regex_match(mac_addr, reg))
+        {
+            std::replace(mac_addr.begin(), mac_addr.end(), '-', ':');
+            mac_addr_vec.emplace_back(std::move(mac_addr));
+            target_alias_vec.emplace_back();
+        }
+        else
+        {
+            target_alias_vec.emplace_back(mac_addr);
+            auto addr_it = mac_addr_map.find(mac_addr);
+            if (addr_it == mac_addr_map.end())
+            {
+                fprintf(stderr, "no aliase: %s found\n", mac_addr.c_str());
+                return false;
+            }
+
+            std::replace(addr_it->second.begin(), addr_it->second.end(), '-', ':');
+            mac_addr_vec.emplace_back(addr_it->second);
+        }
+    }
+
+    return send_magic_packets(cmd_map, mac_addr_map, mac_addr_vec, target_alias_vec);
+}
+
+// digits only, std::stoul would take "-1" as ULONG_MAX
+static bool parse_uint(const std::string &str, const uint32_t max_value, uint32_t &value)
+{
+    if (str.empty() || str.size() > 10 || str.find_first_not_of("0123456789") != std::string::npos)
+    {
+        return false;
+    }
+    auto parsed = std::stoull(str);
+    if (parsed > max_value)
+    {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+/*
+   sends the magic packets for targets already resolved to ':' separated mac
+   addresses, target_alias_vec holds the alias each one came from or "" for a
+   bare mac address
+*/
+static bool send_magic_packets(const std::map<std::string, std::string> &cmd_map,
+                               const std::map<std::string, std::string> &mac_addr_map,
+                               const std::vector<std::string> &mac_addr_vec,
+                               const std::vector<std::string> &target_alias_vec)
+{
+    constexpr uint32_t kMaxRepeat = 1000000;
+    constexpr uint32_t kMaxGapUs = 60 * 1000 * 1000;
+
+    std::string bcast_addr = "255.255.255.255";
+    std::vector<uint16_t> port_vec = {9};
+    uint32_t repeat = 1;
+    uint32_t gap_us = 0;
+    std::set<std::string> interface_set;
+
+    auto it = cmd_map.find("bcast");
+    if (it != cmd_map.end())
+    {
+        bcast_addr = it->second;
+    }
+    it = cmd_map.find("port");
+    if (it != cmd_map.end())
+    {
+        port_vec.clear();
+        for (auto &port : split(it->second, ','))
+        {
+            port_vec.emplace_back(std::stoi(port));
+        }
+    }
+    it = cmd_map.find("repeat");
+    if (it != cmd_map.end())
+    {
+        if (!parse_uint(it->second, kMaxRepeat, repeat) || repeat == 0)
+        {
+            fprintf(stderr, "invalid repeat: %s, must be 1 to %u\n", it->second.c_str(), kMaxRepeat);
+            return false;
+        }
+    }
+    it = cmd_map.find("gap");
+    if (it != cmd_map.end() && !parse_uint(it->second, kMaxGapUs, gap_us))
+    {
+        fprintf(stderr, "invalid gap: %s, must be 0 to %u us\n", it->second.c_str(), kMaxGapUs);
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (inet_aton(bcast_addr.c_str(), &addr.sin_addr) == 0)
+    {
+        fprintf(stderr, "Invalid remote ip address given: %s\n", bcast_addr.c_str());
+        return false;
+    }
+
+    struct timespec start_ts;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    std::vector<std::vector<unsigned char>> packet_vec;
+    for (auto &mac_addr : mac_addr_vec)
+    {
+        packet_vec.emplace_back(package_magic_data(mac_addr));
+    }
+
+    bool raw = cmd_map.count("raw") != 0;
+    bool unicast = cmd_map.count("unicast") != 0;
+    std::vector<uint32_t> dst_ip_vec(mac_addr_vec.size(), addr.sin_addr.s_addr);
+    if (unicast)
+    {
+        if (raw)
+        {
+            fprintf(stderr, "--unicast sends udp, it cannot be used with --raw\n");
+            return false;
+        }
+        if (!resolve_unicast_ips(mac_addr_map, target_alias_vec, mac_addr_vec, dst_ip_vec))
+        {
+            return false;
+        }
+    }
+
+    it = cmd_map.find("pcap");
+    if (it != cmd_map.end())
+    {
+        return write_pcap(it->second, cmd_map.count("mmap") != 0, raw, unicast, dst_ip_vec,
+                          packet_vec, port_vec, repeat, gap_us, start_ts);
+    }
+
+    if (unicast)
+    {
+        it = cmd_map.find("interface");
+        return send_unicast(it != cmd_map.end() ? it->second : "", cmd_map.count("keep-neigh") != 0,
+                            mac_addr_vec, dst_ip_vec, packet_vec, port_vec, repeat, gap_us);
+    }
+
+    it = cmd_map.find("interface");
+    if (it != cmd_map.end())
+    {
+        interface_set.emplace(it->second);
+    }
+
+    if (interface_set.empty())
+    {
+        interface_set = get_interfaces();
+        if (interface_set.empty())
+        {
+            fprintf(stderr, "get network interfaces failed, errno:%d, dsec:%s\n", errno, strerror(errno));
+            return false;
+        }
+    }
+
+    std::vector<int> sock_vec;
+    do_on_exit close_socks([&sock_vec]()
+    {
+        for (auto sock : sock_vec)
+        {
+            close(sock);
+        }
+    });
+
+    // raw packets go out as ethertype 0x0842 broadcast frames, one per interface
+    std::vector<struct sockaddr_ll> ll_addr_vec;
+    for (auto &interface : interface_set)
+    {
+        int sock = raw ? socket(AF_PACKET, SOCK_DGRAM, htons(kEtherTypeWol)) : socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock  < 0 )
+        {
+            fprintf(stderr, "cannot open socket, errno:%d, dsec:%s\n", errno, strerror(errno));
+            return false;
+        }
+        sock_vec.emplace_back(sock);
+
+        int optval = 1;
+        if (!raw && setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (char *) &optval, sizeof(optval)) < 0)
+        {
+            fprintf(stderr, "cannot set socket options, errno:%d, desc:%s\n", errno, strerror(errno));
+            return false;
+        }
+
+        struct ifreq req;
+        memset(&req, 0, sizeof(req));
+        strncpy(req.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+        if (ioctl(sock, SIOCGIFINDEX, &req) < 0)
+        {
+            fprintf(stderr, "cannot get interface: %s, errno:%d, dsec:%s\n", interface.c_str(), errno, strerror(errno));
+            return false;
+        }
+
+        struct sockaddr_ll ll_addr;
+        memset(&ll_addr, 0, sizeof(ll_addr));
+        ll_addr.sll_family = AF_PACKET;
+        ll_addr.sll_protocol = htons(kEtherTypeWol);
+        ll_addr.sll_ifindex = req.ifr_ifindex;
+        ll_addr.sll_halen = ETH_ALEN;
+        memset(ll_addr.sll_addr, 0xff, ETH_ALEN);
+        ll_addr_vec.emplace_back(ll_addr);
+    }
+
+    // every round sends one copy to each target, so copies of the same
+    // packet are at least gap_us apart and never back to back
+    for (uint32_t round = 0; round < repeat; ++round)
+    {
+        if (round != 0 && gap_us != 0)
+        {
+            usleep(gap_us);
+        }
+
+        for (auto &packet : packet_vec)
+        {
+            for (std::size_t index = 0; index < sock_vec.size(); ++index)
+            {
+                auto sock = sock_vec[index];
+                if (raw)
+                {
+                    if (sendto(sock, &packet[0], packet.size(), 0, (struct sockaddr *)&ll_addr_vec[index], sizeof(struct sockaddr_ll)) < 0)
+                    {
+                        fprintf(stderr, "cannot send data, errno:%d,  desc:%s\n", errno, strerror(errno));
+                        return false;
+                    }
+                    continue;
+                }
+
+                for (auto port : port_vec)
+                {
+                    addr.sin_port = htons(port);
+                    if (sendto(sock, &packet[0], packet.size(), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+                    {
+                        fprintf(stderr, "cannot send data, errno:%d,  desc:%s\n", errno, strerror(errno));
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+
+    for (auto &mac_addr : mac_addr_vec)
+    {
+        for (auto &interface : interface_set)
+        {
+            if (repeat > 1)
+            {
+                printf("Successful sent %u WOL magic packets to: %s by interface: %s\n", repeat, mac_addr.c_str(), interface.c_str());
+            }
+            else
+            {
+                printf("Successful sent WOL magic packet to: %s by interface: %s\n", mac_addr.c_str(), interface.c_str());
+            }
+        }
+    }
+
+    return true;
+}
+
+static uint64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static std::string ms_to_time_str(const uint64_t ms)
+{
+    time_t sec = ms / 1000;
+    struct tm tm_val;
+    localtime_r(&sec, &tm_val);
+
+    char buf[64];
+    auto len = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm_val);
+    snprintf(buf + len, sizeof(buf) - len, ".%03u", static_cast<uint32_t>(ms % 1000));
+    return buf;
+}
+
+static bool parse_interval_ms(const std::string &str, uint64_t &interval_ms)
+{
+    static const std::regex reg("^([0-9]+)(ms|s|m|h|d)$");
+    std::smatch match_result;
+    if (!std::regex_match(str, match_result, reg))
+    {
+        return false;
+    }
+
+    static const std::map<std::string, uint64_t> unit_map = {
+        {"ms", 1}, {"s", 1000}, {"m", 60 * 1000}, {"h", 3600 * 1000}, {"d", 86400 * 1000}};
+    interval_ms = std::stoull(match_result[1]) * unit_map.at(match_result[2]);
+    return interval_ms != 0;
+}
+
+static bool parse_time_ms(const std::string &str, const uint64_t now, uint64_t &time_ms)
+{
+    if (!str.empty() && str[0] == '+')
+    {
+        uint64_t interval_ms = 0;
+        if (!parse_interval_ms(str.substr(1), interval_ms))
+        {
+            return false;
+        }
+        time_ms = now + interval_ms;
+        return true;
+    }
+
+    time_t now_sec = now / 1000;
+    struct tm now_tm;
+    localtime_r(&now_sec, &now_tm);
+    now_tm.tm_sec = 0;
+    now_tm.tm_isdst = -1;
+
+    char tail = 0;
+    bool time_of_day = false;
+    struct tm tm_val = now_tm;
+    int ret = sscanf(str.c_str(), "%d-%d-%dT%d:%d:%d%c", 
+                     &tm_val.tm_year, &tm_val.tm_mon, &tm_val.tm_mday,
+                     &tm_val.tm_hour, &tm_val.tm_min, &tm_val.tm_sec, &tail);
+    if (ret == 5 || ret == 6)
+    {
+        tm_val.tm_year -= 1900;
+        tm_val.tm_mon -= 1;
+    }
+    else
+    {
+        tm_val = now_tm;
+        ret = sscanf(str.c_str(), "%d:%d:%d%c", &tm_val.tm_hour, &tm_val.tm_min, &tm_val.tm_sec, &tail);
+        if (ret != 2 && ret != 3)
+        {
+            return false;
+        }
+        time_of_day = true;
+    }
+
+    // mktime would quietly move e.g. 25:99 or month 13 to some other time
+    if (tm_val.tm_year < 70
+        || tm_val.tm_mon < 0 || tm_val.tm_mon > 11
+        || tm_val.tm_mday < 1 || tm_val.tm_mday > 31
+        || tm_val.tm_hour < 0 || tm_val.tm_hour > 23
+        || tm_val.tm_min < 0 || tm_val.tm_min > 59
+        || tm_val.tm_sec < 0 || tm_val.tm_sec > 59)
+    {
+        return false;
+    }
+
+    auto mday = tm_val.tm_mday;
+    auto sec = mktime(&tm_val);
+    if (sec < 0 || tm_val.tm_mday != mday)
+    {
+        // the day does not exist in that month, e.g. 2026-02-30
+        return false;
+    }
+
+    // a bare time of day means its next occurrence
+    if (time_of_day && static_cast<uint64_t>(sec) * 1000 <= now)
+    {
+        tm_val.tm_mday += 1;
+        tm_val.tm_isdst = -1;
+        sec = mktime(&tm_val);
+    }
+
+    time_ms = static_cast<uint64_t>(sec) * 1000;
+    return true;
+}
+
+static uint64_t next_fire_ms(const schedule_entry &entry, const uint64_t now)
+{
+    if (entry.every_ms == 0 || entry.first_ms >= now)
+    {
+        return entry.first_ms;
+    }
+
+    auto periods = (now - entry.first_ms + entry.every_ms - 1) / entry.every_ms;
+    return entry.first_ms + periods * entry.every_ms;
+}
+
+static std::map<std::string, schedule_entry> parse_schedules(const std::string &data)
+{
+    std::size_t pos = 0;
+    std::size_t data_size = data.size();
+
+    std::map<std::string, schedule_entry> schedule_map;
+    while (data_size - pos > kScheduleHeadSize)
+    {
+        schedule_entry entry;
+        memcpy(&entry.first_ms, &data[pos], sizeof(uint64_t));
+        memcpy(&entry.every_ms, &data[pos + sizeof(uint64_t)], sizeof(uint64_t));
+        pos += kScheduleHeadSize;
+
+        std::string fields[2];
+        for (auto &field : fields)
+        {
+            uint16_t field_size = 0;
+            if (data_size - pos > kAliasSize)
+            {
+                memcpy(&field_size, &data[pos], kAliasSize);
+            }
+            if (field_size == 0
+                || (data_size - pos) < (kAliasSize + field_size))
+            {
+                fprintf(stderr, "schedule file: %s invalid, please remove it\n", s_schedule_file_path.c_str());
+                exit(1);
+            }
+
+            field = data.substr(pos + kAliasSize, field_size);
+            pos += kAliasSize + field_size;
+        }
+
+        entry.target = std::move(fields[0]);
+        schedule_map.emplace(std::move(fields[1]), std::move(entry));
+    }
+
+    return schedule_map;
+}
+
+static std::string schedules_to_str(const std::map<std::string, schedule_entry> &schedule_map)
+{
+    std::string data_str;
+    std::size_t total_size = 0;
+    for (auto &item : schedule_map)
+    {
+        total_size += kScheduleHeadSize + kAliasSize * 2;
+        total_size += item.first.size() + item.second.target.size();
+    }
+
+    if (total_size == 0)
+    {
+        return data_str;
+    }
+
+    data_str.resize(total_size);
+    std::size_t pos = 0;
+    for (auto &item : schedule_map)
+    {
+        memcpy(&data_str[pos], &item.second.first_ms, sizeof(uint64_t));
+        pos += sizeof(uint64_t);
+        memcpy(&data_str[pos], &item.second.every_ms, sizeof(uint64_t));
+        pos += sizeof(uint64_t);
+        for (auto field : {&item.second.target, &item.first})
+        {
+            uint16_t field_size = field->size();
+            memcpy(&data_str[pos], &field_size, kAliasSize);
+            pos += kAliasSize;
+            memcpy(&data_str[pos], &(*field)[0], field_size);
+            pos += field_size;
+        }
+    }
+
+    return data_str;
+}
+
+/*
+   serializes read-modify-write of the schedule file between the scheduler and
+   wol schedule add/remove, the file is replaced by rename so the lock is kept
+   on a separate file
+*/
+static int lock_schedules()
+{
+    auto lock_file_path = s_schedule_file_path + ".lock";
+    int fd = ::open(lock_file_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+    if (fd < 0)
+    {
+        fprintf(stderr, "open file: %s failed, errno:%d, dsec:%s\n", lock_file_path.c_str(), errno, strerror(errno));
+        return -1;
+    }
+
+    while (flock(fd, LOCK_EX) != 0)
+    {
+        if (errno != EINTR)
+        {
+            fprintf(stderr, "lock file: %s failed, errno:%d, dsec:%s\n", lock_file_path.c_str(), errno, strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+static bool read_schedules(file_helper &file, std::map<std::string, schedule_entry> &schedule_map)
+{
+    if (!file.open(s_schedule_file_path, O_RDONLY | O_CREAT))
+    {
+        return false;
+    }
+    std::string data;
+    if (!file.read(data))
+    {
+        return false;
+    }
+    schedule_map = parse_schedules(data);
+    return true;
+}
+
+static bool handle_schedule(int argc, char **argv)
+{
+    std::string sub_cmd = argv[0];
+    int lock_fd = lock_schedules();
+    if (lock_fd < 0)
+    {
+        return false;
+    }
+    do_on_exit unlock([lock_fd]() { close(lock_fd); });
+
+    file_helper file;
+    std::map<std::string, schedule_entry> schedule_map;
+    if (!read_schedules(file, schedule_map))
+    {
+        return false;
+    }
+
+    if (sub_cmd == "list")
+    {
+        if (schedule_map.empty())
+        {
+            printf("no schedules\n");
+            return true;
+        }
+
+        auto now = now_ms();
+        printf("all schedules:\n");
+        for (auto &item : schedule_map)
+        {
+            auto &entry = item.second;
+            printf("    %s    %s    next: %s", item.first.c_str(), entry.target.c_str(),
+                   ms_to_time_str(next_fire_ms(entry, now)).c_str());
+            if (entry.every_ms != 0)
+            {
+                printf("    every: %llums", static_cast<unsigned long long>(entry.every_ms));
+            }
+            printf("\n");
+        }
+        return true;
+    }
+    else if (sub_cmd == "remove" && argc >= 2)
+    {
+        auto it = schedule_map.find(argv[1]);
+        if (it == schedule_map.end())
+        {
+            fprintf(stderr, "schedule: %s no found\n", argv[1]);
+            return false;
+        }
+
+        schedule_map.erase(it);
+        if (!file.write_truncate_atomic(schedules_to_str(schedule_map)))
+        {
+            fprintf(stderr, "remove schedule failed\n");
+            return false;
+        }
+        printf("remove schedule: %s ok\n", argv[1]);
+        return true;
+    }
+    else if (sub_cmd == "add" && argc >= 4)
+    {
+        std::string name = argv[1];
+        schedule_entry entry;
+        entry.target = argv[2];
+
+        std::regex reg(s_reg_str);
+        if (!std::regex_match(entry.target, reg))
+        {
+            file_helper alias_file;
+            std::string data;
+            if (!alias_file.open(s_stores_file_path, O_RDONLY | O_CREAT) || !alias_file.read(data))
+            {
+                return false;
+            }
+            if (parse_mac_addr(data).count(entry.target) == 0)
+            {
+                fprintf(stderr, "no aliase: %s found\n", entry.target.c_str());
+                return false;
+            }
+        }
+
+        if (!parse_time_ms(argv[3], now_ms(), entry.first_ms))
+        {
+            fprintf(stderr, "invalid time: %s\n", argv[3]);
+            return false;
+        }
+        if (argc >= 5 && !parse_interval_ms(argv[4], entry.every_ms))
+        {
+            fprintf(stderr, "invalid interval: %s\n", argv[4]);
+            return false;
+        }
+        if (name.size() > UINT16_MAX || entry.target.size() > UINT16_MAX)
+        {
+            fprintf(stderr, "schedule name too long\n");
+            return false;
+        }
+
+        auto it = schedule_map.find(name);
+        if (it != schedule_map.end())
+        {
+            fprintf(stderr, "schedule: %s already exist\n", name.c_str());
+            return false;
+        }
+
+        auto first_str = ms_to_time_str(entry.first_ms);
+        schedule_map.emplace(name, std::move(entry));
+        if (!file.write_truncate_atomic(schedules_to_str(schedule_map)))
+        {
+            fprintf(stderr, "stores schedule failed\n");
+            return false;
+        }
+        printf("stores schedule %s %s at %s ok\n", name.c_str(), argv[2], first_str.c_str());
+        return true;
+    }
+
+    fprintf(stderr, "invalid schedule command, see wol --help\n");
+    return false;
+}
+
+/*
+   targets are resolved to mac addresses once per load, so firing a batch does
+   no alias lookups, regex matching or file reads per target
+*/
+struct schedule_target
+{
+    uint64_t mac = 0;       // 0 when the alias no longer exists
+    std::string mac_addr;   // ':' separated, as package_magic_data wants it
+    std::string alias;      // "" for a bare mac address
+};
+
+struct schedule_state
+{
+    std::vector<std::pair<std::string, schedule_entry>> entries;
+    std::vector<schedule_target> targets;
+    std::vector<uint64_t> next_ms;
+    std::map<std::string, std::string> mac_addr_map;
+    timer_wheel wheel{0};
+    struct timespec mtime = {0, 0};
+    struct timespec alias_mtime = {0, 0};
+};
+
+static bool load_schedules(schedule_state &state)
+{
+    file_helper file;
+    std::map<std::string, schedule_entry> schedule_map;
+    if (!read_schedules(file, schedule_map))
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(file.fd(), &st) == 0)
+    {
+        state.mtime = st.st_mtim;
+    }
+
+    file_helper alias_file;
+    std::string data;
+    if (!alias_file.open(s_stores_file_path, O_RDONLY | O_CREAT) || !alias_file.read(data))
+    {
+        return false;
+    }
+    if (fstat(alias_file.fd(), &st) == 0)
+    {
+        state.alias_mtime = st.st_mtim;
+    }
+    state.mac_addr_map = parse_mac_addr(data);
+    for (auto &item : state.mac_addr_map)
+    {
+        std::replace(item.second.begin(), item.second.end(), '-', ':');
+    }
+
+    state.entries.assign(schedule_map.begin(), schedule_map.end());
+    state.targets.assign(state.entries.size(), schedule_target());
+    std::regex reg(s_reg_str);
+    for (std::size_t id = 0; id < state.entries.size(); ++id)
+    {
+        auto &target = state.targets[id];
+        auto &name = state.entries[id].second.target;
+        auto mac_it = state.mac_addr_map.find(name);
+        if (mac_it != state.mac_addr_map.end())
+        {
+            target.mac_addr = mac_it->second;
+            target.alias = name;
+        }
+        else if (std::regex_match(name, reg))
+        {
+            target.mac_addr = name;
+            std::replace(target.mac_addr.begin(), target.mac_addr.end(), '-', ':');
+        }
+        else
+        {
+            fprintf(stderr, "schedule: %s no aliase: %s found\n", state.entries[id].first.c_str(), name.c_str());
+            continue;
+        }
+        target.mac = mac_str_to_u64(target.mac_addr);
+    }
+
+    auto now = now_ms();
+    state.next_ms.resize(state.entries.size());
+    state.wheel = timer_wheel(now);
+    for (uint32_t id = 0; id < state.entries.size(); ++id)
+    {
+        state.next_ms[id] = next_fire_ms(state.entries[id].second, now);
+        state.wheel.add(state.next_ms[id], id);
+    }
+
+    printf("loaded %zu schedules\n", state.entries.size());
+    return true;
+}
+
+// the schedules or the aliases they resolve through changed on disk
+static bool schedules_changed(const schedule_state &state)
+{
+    auto changed = [](const std::string &file_path, const struct timespec &mtime)
+    {
+        struct stat st;
+        if (stat(file_path.c_str(), &st) != 0)
+        {
+            return false;
+        }
+        return st.st_mtim.tv_sec != mtime.tv_sec || st.st_mtim.tv_nsec != mtime.tv_nsec;
+    };
+
+    return changed(s_schedule_file_path, state.mtime) || changed(s_stores_file_path, state.alias_mtime);
+}
+
+// drops fired one-shot schedules from the stores file, keeping anything added meanwhile
+static void remove_fired_schedules(schedule_state &state, const std::vector<std::string> &names)
+{
+    int lock_fd = lock_schedules();
+    if (lock_fd < 0)
+    {
+        return;
+    }
+    do_on_exit unlock([lock_fd]() { close(lock_fd); });
+
+    // a schedule added since the last load makes the mtime differ, then keep
+    // state.mtime as it is so the next loop still loads the addition
+    struct stat st;
+    bool unchanged = stat(s_schedule_file_path.c_str(), &st) == 0
+                     && st.st_mtim.tv_sec == state.mtime.tv_sec
+                     && st.st_mtim.tv_nsec == state.mtime.tv_nsec;
+
+    file_helper file;
+    std::map<std::string, schedule_entry> schedule_map;
+    if (!read_schedules(file, schedule_map))
+    {
+        return;
+    }
+
+    for (auto &name : names)
+    {
+        schedule_map.erase(name);
+    }
+    if (!file.write_truncate_atomic(schedules_to_str(schedule_map)))
+    {
+        fprintf(stderr, "remove fired schedules failed\n");
+        return;
+    }
+
+    if (unchanged && stat(s_schedule_file_path.c_str(), &st) == 0)
+    {
+        state.mtime = st.st_mtim;
+    }
+}
+
+static void fire_schedules(schedule_state &state,
+                           const std::map<std::string, std::string> &cmd_map,
+                           const std::vector<uint32_t> &expired)
+{
+    auto now = now_ms();
+    std::unordered_set<uint64_t> mac_set;
+    std::vector<std::string> mac_addr_vec;
+    std::vector<std::string> target_alias_vec;
+    std::vector<std::string> fired_once_vec;
+    for (auto id : expired)
+    {
+        auto &item = state.entries[id];
+        auto &target = state.targets[id];
+        if (target.mac != 0 && mac_set.insert(target.mac).second)
+        {
+            mac_addr_vec.emplace_back(target.mac_addr);
+            target_alias_vec.emplace_back(target.alias);
+        }
+
+        if (item.second.every_ms == 0)
+        {
+            fired_once_vec.emplace_back(item.first);
+            continue;
+        }
+
+        // skip the periods missed while we were late, if any
+        state.next_ms[id] = next_fire_ms(item.second, std::max(now, state.next_ms[id] + 1));
+        state.wheel.add(state.next_ms[id], id);
+    }
+
+    if (!mac_addr_vec.empty())
+    {
+        printf("%s: waking %zu machines\n", ms_to_time_str(now).c_str(), mac_addr_vec.size());
+        if (!send_magic_packets(cmd_map, state.mac_addr_map, mac_addr_vec, target_alias_vec))
+        {
+            // past one-shot schedules fire right after a load, so they are retried
+            // once the schedule file changes or the scheduler restarts
+            fprintf(stderr, "%s: waking failed, %zu one-shot schedules kept\n",
+                    ms_to_time_str(now_ms()).c_str(), fired_once_vec.size());
+            return;
+        }
+    }
+
+    if (!fired_once_vec.empty())
+    {
+        remove_fired_schedules(state, fired_once_vec);
+    }
+}
+
+static bool run_schedules(const std::map<std::string, std::string> &cmd_map)
+{
+    // a larger gap means the clock was stepped or we were stopped, start over
+    constexpr uint64_t kMaxLagMs = 60 * 1000;
+    constexpr uint64_t kReloadCheckMs = 1000;
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    schedule_state state;
+    if (!load_schedules(state))
+    {
+        return false;
+    }
+
+    std::vector<uint32_t> expired;
+    while (true)
+    {
+        auto now = now_ms();
+        auto base = state.wheel.base_ms();
+        if (schedules_changed(state) || now + kMaxLagMs < base || now > base + kMaxLagMs)
+        {
+            if (!load_schedules(state))
+            {
+                return false;
+            }
+        }
+
+        expired.clear();
+        state.wheel.advance(now, expired);
+        if (!expired.empty())
+        {
+            fire_schedules(state, cmd_map, expired);
+        }
+
+        auto timeout = state.wheel.next_timeout(now_ms(), kReloadCheckMs);
+        if (timeout != 0)
+        {
+            usleep(timeout * 1000);
+        }
+    }
+
+    return true;
+}
+
+void timer_wheel::add(const uint64_t expire_ms, const uint32_t id)
+{
+    constexpr uint64_t kMaxDelta = (1ULL << (kSlotBits * kLevels)) - 1;
+
+    entry item{expire_ms, id};
+    ++size_;
+    if (expire_ms < base_ms_)
+    {
+        slots_[0][base_ms_ & kSlotMask].emplace_back(item);
+        return;
+    }
+
+    uint64_t delta = expire_ms - base_ms_;
+    if (delta > kMaxDelta)
+    {
+        delta = kMaxDelta;
+        item.expire_ms = base_ms_ + delta;
+    }
+
+    uint32_t level = 0;
+    while (level + 1 < kLevels && delta >= (1ULL << (kSlotBits * (level + 1))))
+    {
+        ++level;
+    }
+    slots_[level][(item.expire_ms >> (kSlotBits * level)) & kSlotMask].emplace_back(item);
+}
+
+void timer_wheel::cascade(const uint32_t level)
+{
+    auto &slot = slots_[level][(base_ms_ >> (kSlotBits * level)) & kSlotMask];
+    std::vector<entry> entries;
+    entries.swap(slot);
+    size_ -= entries.size();
+    for (auto &item : entries)
+    {
+        add(item.expire_ms, item.id);
+    }
+}
+
+void timer_wheel::advance(const uint64_t now_ms, std::vector<uint32_t> &expired)
+{
+    while (base_ms_ <= now_ms)
+    {
+        auto index = base_ms_ & kSlotMask;
+        for (uint32_t level = 1; index == 0 && level < kLevels; ++level)
+        {
+            cascade(level);
+            index = (base_ms_ >> (kSlotBits * level)) & kSlotMask;
+        }
+
+        auto &slot = slots_[0][base_ms_ & kSlotMask];
+        for (auto &item : slot)
+        {
+            expired.emplace_back(item.id);
+        }
+        size_ -= slot.size();
+        slot.clear();
+        ++base_ms_;
+    }
+}
+
+uint64_t timer_wheel::next_timeout(const uint64_t now_ms, const uint64_t max_ms) const
+{
+    uint64_t timeout = max_ms;
+    if (size_ != 0 && (base_ms_ & kSlotMask) == 0)
+    {
+        // the upper levels cascade into level 0 on the next advance(), until
+        // then the level 0 slots don't show what expires in this block
+        timeout = std::min(timeout, base_ms_ > now_ms ? base_ms_ - now_ms : 0);
+    }
+    else if (size_ != 0)
+    {
+        // first busy slot before the level 0 wheel wraps, or the wrap itself
+        uint64_t when = base_ms_;
+        while ((when & kSlotMask) != 0 || when == base_ms_)
+        {
+            if (!slots_[0][when & kSlotMask].empty())
+            {
+                break;
+            }
+            ++when;
+        }
+        timeout = std::min(timeout, when > now_ms ? when - now_ms : 0);
+    }
+
+    return timeout;
+}
+
+static volatile sig_atomic_t s_stop_listen = 0;
+
+struct listen_stat
+{
+    uint64_t count = 0;
+    uint64_t last_count = 0;
+};
+
+static uint64_t mac_from_bytes(const unsigned char *data)
+{
+    uint64_t mac = 0;
+    for (uint32_t i = 0; i < ETH_ALEN; ++i)
+    {
+        mac = (mac << 8) | data[i];
+    }
+    return mac;
+}
+
+static void mac_to_bytes(uint64_t mac, unsigned char *data)
+{
+    for (int i = ETH_ALEN - 1; i >= 0; --i, mac >>= 8)
+    {
+        data[i] = mac & 0xff;
+    }
+}
+
+// checks the 6 x 0xff + 16 x mac layout built by package_magic_data,
+// trailing bytes such as a SecureOn password are allowed
+static bool parse_magic_data(const unsigned char *data, const std::size_t size, uint64_t &mac)
+{
+    if (size < kMagicDataSize)
+    {
+        return false;
+    }
+
+    static const unsigned char sync_data[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    if (memcmp(data, sync_data, 6) != 0)
+    {
+        return false;
+    }
+
+    for (uint32_t pos = 12; pos < kMagicDataSize; pos += 6)
+    {
+        if (memcmp(data + 6, data + pos, 6) != 0)
+        {
+            return false;
+        }
+    }
+
+    mac = mac_from_bytes(data + 6);
+    return true;
+}
+
+static std::string mac_to_str(const uint64_t mac)
+{
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02x:%02x:%02x:%02x:%02x:%02x",
+             static_cast<uint32_t>(mac >> 40) & 0xff, static_cast<uint32_t>(mac >> 32) & 0xff,
+             static_cast<uint32_t>(mac >> 24) & 0xff, static_cast<uint32_t>(mac >> 16) & 0xff,
+             static_cast<uint32_t>(mac >> 8) & 0xff, static_cast<uint32_t>(mac) & 0xff);
+    return buf;
+}
+
+static uint64_t mac_str_to_u64(const std::string &mac_addr)
+{
+    uint64_t mac = 0;
+    for (auto &item : split(mac_addr.substr(0, kMACSize), mac_addr[2]))
+    {
+        mac = (mac << 8) | std::stoul(item, 0, 16);
+    }
+    return mac;
+}
+
+static void print_listen_stats(std::unordered_map<uint64_t, listen_stat> &stat_map,
+                               const std::map<uint64_t, std::string> &alias_map,
+                               const double elapsed_sec,
+                               const uint64_t invalid_count,
+                               const uint64_t drop_count)
+{
+    std::map<uint64_t, listen_stat *> sorted_map;
+    for (auto &item : stat_map)
+    {
+        if (item.second.count != item.second.last_count)
+        {
+            sorted_map.emplace(item.first, &item.second);
+        }
+    }
+
+    for (auto &item : sorted_map)
+    {
+        auto alias_it = alias_map.find(item.first);
+        auto rate = (item.second->count - item.second->last_count) / elapsed_sec;
+        printf("    %s    %-16s    total: %-10llu    rate: %.0f/s\n",
+               mac_to_str(item.first).c_str(),
+               alias_it == alias_map.end() ? "-" : alias_it->second.c_str(),
+               static_cast<unsigned long long>(item.second->count),
+               rate);
+        item.second->last_count = item.second->count;
+    }
+
+    static uint64_t s_last_invalid_count = 0;
+    static uint64_t s_last_drop_count = 0;
+    if (!sorted_map.empty() || invalid_count != s_last_invalid_count || drop_count != s_last_drop_count)
+    {
+        s_last_invalid_count = invalid_count;
+        s_last_drop_count = drop_count;
+        printf("%s: %zu macs, invalid: %llu, dropped: %llu\n",
+               ms_to_time_str(now_ms()).c_str(),
+               stat_map.size(),
+               static_cast<unsigned long long>(invalid_count),
+               static_cast<unsigned long long>(drop_count));
+    }
+}
+
+static bool listen_wol(const std::map<std::string, std::string> &cmd_map)
+{
+    constexpr uint32_t kBatchSize = 64;
+    constexpr uint32_t kFrameSize = 2048;
+    // batches drained from one socket per poll wakeup, so a flooded socket
+    // cannot starve the other sockets, the report or ctrl-c
+    constexpr uint32_t kMaxDrainBatches = 16;
+    constexpr int kRecvBufSize = 32 * 1024 * 1024;
+
+    std::vector<uint16_t> port_vec = {7, 9};
+    std::string interface;
+    auto it = cmd_map.find("port");
+    if (it != cmd_map.end())
+    {
+        port_vec.clear();
+        for (auto &port : split(it->second, ','))
+        {
+            port_vec.emplace_back(std::stoi(port));
+        }
+    }
+    it = cmd_map.find("interface");
+    if (it != cmd_map.end())
+    {
+        interface = it->second;
+    }
+
+    file_helper file;
+    std::string data;
+    if (!file.open(s_stores_file_path, O_RDONLY | O_CREAT) || !file.read(data))
+    {
+        return false;
+    }
+    std::map<uint64_t, std::string> alias_map;
+    for (auto &item : parse_mac_addr(data))
+    {
+        auto &alias = alias_map[mac_str_to_u64(item.second)];
+        alias.append(alias.empty() ? "" : ",").append(item.first);
+    }
+
+    std::vector<int> sock_vec;
+    do_on_exit close_socks([&sock_vec]()
+    {
+        for (auto sock : sock_vec)
+        {
+            close(sock);
+        }
+    });
+
+    auto setup_sock = [&](int sock) -> bool
+    {
+        sock_vec.emplace_back(sock);
+        // SO_RCVBUFFORCE ignores rmem_max when we have CAP_NET_ADMIN
+        int buf_size = kRecvBufSize;
+        if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &buf_size, sizeof(buf_size)) < 0)
+        {
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &buf_size, sizeof(buf_size));
+        }
+        if (!interface.empty()
+            && setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, interface.c_str(), interface.size()) < 0)
+        {
+            fprintf(stderr, "cannot bind to interface: %s, errno:%d, desc:%s\n", interface.c_str(), errno, strerror(errno));
+            return false;
+        }
+        return true;
+    };
+
+    for (auto port : port_vec)
+    {
+        int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock < 0)
+        {
+            fprintf(stderr, "cannot open socket, errno:%d, dsec:%s\n", errno, strerror(errno));
+            return false;
+        }
+        if (!setup_sock(sock))
+        {
+            return false;
+        }
+
+        // the kernel reports the socket's drop counter with every datagram
+        int optval = 1;
+        setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, &optval, sizeof(optval));
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            fprintf(stderr, "cannot bind udp port: %u, errno:%d, desc:%s\n", port, errno, strerror(errno));
+            return false;
+        }
+    }
+
+    // SOCK_DGRAM packet sockets hand us the payload without the ethernet header,
+    // they need root, without it we only listen on the udp ports
+    // opened with protocol 0 it receives nothing until bind, SO_BINDTODEVICE
+    // does not apply to packet sockets so bind picks the interface too
+    int raw_sock = socket(AF_PACKET, SOCK_DGRAM, 0);
+    if (raw_sock < 0)
+    {
+        fprintf(stderr, "cannot open packet socket, listening on udp only, errno:%d, dsec:%s\n", errno, strerror(errno));
+    }
+    else
+    {
+        if (!setup_sock(raw_sock))
+        {
+            return false;
+        }
+
+        struct sockaddr_ll ll_addr;
+        memset(&ll_addr, 0, sizeof(ll_addr));
+        ll_addr.sll_family = AF_PACKET;
+        ll_addr.sll_protocol = htons(kEtherTypeWol);
+        ll_addr.sll_ifindex = interface.empty() ? 0 : if_nametoindex(interface.c_str());
+        if (bind(raw_sock, (struct sockaddr *)&ll_addr, sizeof(ll_addr)) < 0)
+        {
+            fprintf(stderr, "cannot bind packet socket, errno:%d, desc:%s\n", errno, strerror(errno));
+            return false;
+        }
+    }
+
+    std::vector<unsigned char> frame_data(kBatchSize * kFrameSize);
+    std::vector<char> control_data(kBatchSize * CMSG_SPACE(sizeof(uint32_t)));
+    struct mmsghdr msgs[kBatchSize];
+    struct iovec iovecs[kBatchSize];
+    struct sockaddr_ll addrs[kBatchSize];
+
+    std::unordered_map<uint64_t, listen_stat> stat_map;
+    std::vector<uint32_t> udp_drop_vec(sock_vec.size(), 0);
+    uint64_t invalid_count = 0;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = [](int) { s_stop_listen = 1; };
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    std::vector<struct pollfd> poll_vec;
+    for (auto sock : sock_vec)
+    {
+        poll_vec.push_back({sock, POLLIN, 0});
+    }
+
+    printf("listening on udp ports %s%s%s%s\n",
+           cmd_map.count("port") != 0 ? cmd_map.at("port").c_str() : "7,9",
+           raw_sock < 0 ? "" : " and ethertype 0x0842",
+           interface.empty() ? "" : " by interface: ",
+           interface.c_str());
+
+    uint64_t raw_drop_count = 0;
+    auto drop_count = [&]() -> uint64_t
+    {
+        struct tpacket_stats packet_stats;
+        socklen_t stats_len = sizeof(packet_stats);
+        if (raw_sock >= 0 && getsockopt(raw_sock, SOL_PACKET, PACKET_STATISTICS, &packet_stats, &stats_len) == 0)
+        {
+            // reading PACKET_STATISTICS resets the kernel counters
+            raw_drop_count += packet_stats.tp_drops;
+        }
+
+        uint64_t count = raw_drop_count;
+        for (auto drops : udp_drop_vec)
+        {
+            count += drops;
+        }
+        return count;
+    };
+
+    auto start_ms = now_ms();
+    auto last_print_ms = start_ms;
+    while (!s_stop_listen)
+    {
+        auto now = now_ms();
+        if (now >= last_print_ms + 1000)
+        {
+            print_listen_stats(stat_map, alias_map, (now - last_print_ms) / 1000.0, invalid_count, drop_count());
+            last_print_ms = now;
+        }
+
+        auto ret = poll(&poll_vec[0], poll_vec.size(), last_print_ms + 1000 - now);
+        if (ret < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "poll failed, errno:%d, desc:%s\n", errno, strerror(errno));
+            return false;
+        }
+
+        for (std::size_t index = 0; ret > 0 && index < poll_vec.size(); ++index)
+        {
+            if (!(poll_vec[index].revents & POLLIN))
+            {
+                continue;
+            }
+
+            memset(msgs, 0, sizeof(msgs));
+            for (uint32_t i = 0; i < kBatchSize; ++i)
+            {
+                iovecs[i].iov_base = &frame_data[i * kFrameSize];
+                iovecs[i].iov_len = kFrameSize;
+                msgs[i].msg_hdr.msg_iov = &iovecs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_name = &addrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+                msgs[i].msg_hdr.msg_control = &control_data[i * CMSG_SPACE(sizeof(uint32_t))];
+                msgs[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint32_t));
+            }
+
+            // drain the socket before going back to poll, whatever is left
+            // keeps the socket readable for the next wakeup
+            for (uint32_t batch = 0; batch < kMaxDrainBatches && !s_stop_listen; ++batch)
+            {
+                if (batch > 0 && now_ms() >= last_print_ms + 1000)
+                {
+                    break;
+                }
+
+                auto count = recvmmsg(poll_vec[index].fd, msgs, kBatchSize, MSG_DONTWAIT, nullptr);
+                if (count <= 0)
+                {
+                    break;
+                }
+
+                for (int i = 0; i < count; ++i)
+                {
+                    // the packet socket sees the frames this host sends as well, e.g. on lo
+                    uint64_t mac = 0;
+                    if (poll_vec[index].fd != raw_sock || addrs[i].sll_pkttype != PACKET_OUTGOING)
+                    {
+                        if (parse_magic_data(&frame_data[i * kFrameSize], msgs[i].msg_len, mac))
+                        {
+                            ++stat_map[mac].count;
+                        }
+                        else
+                        {
+                            ++invalid_count;
+                        }
+                    }
+
+                    for (auto cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg))
+                    {
+                        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL)
+                        {
+                            memcpy(&udp_drop_vec[index], CMSG_DATA(cmsg), sizeof(uint32_t));
+                        }
+                    }
+                    msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+                    msgs[i].msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint32_t));
+                }
+
+                if (static_cast<uint32_t>(count) < kBatchSize)
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    // the summary shows the average rate over the whole run
+    printf("summary:\n");
+    for (auto &item : stat_map)
+    {
+        item.second.last_count = 0;
+    }
+    auto elapsed_ms = std::max<uint64_t>(now_ms() - start_ms, 1);
+    print_listen_stats(stat_map, alias_map, elapsed_ms / 1000.0, invalid_count, drop_count());
+    return true;
+}
+
+static std::string ip_to_str(const uint32_t ip)
+{
+    struct in_addr addr;
+    addr.s_addr = ip;
+    return inet_ntoa(addr);
+}
+
+static bool parse_subnet(const std::string &str, uint32_t &network, uint32_t &mask)
+{
+    auto pos = str.find('/');
+    struct in_addr addr;
+    if (pos == std::string::npos || inet_aton(str.substr(0, pos).c_str(), &addr) == 0)
+    {
+        return false;
+    }
+
+    auto prefix_str = str.substr(pos + 1);
+    if (prefix_str.empty() || prefix_str.find_first_not_of("0123456789") != std::string::npos)
+    {
+        return false;
+    }
+    auto prefix = std::stoul(prefix_str);
+    if (prefix > 32)
+    {
+        return false;
+    }
+
+    mask = prefix == 0 ? 0 : htonl(0xffffffffu << (32 - prefix));
+    network = addr.s_addr & mask;
+    return true;
+}
+
+// dumps the kernel ipv4 neighbor table with a single RTM_GETNEIGH request
+static bool dump_neighbors(const int ifindex, std::vector<neigh_entry> &neigh_vec)
+{
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock < 0)
+    {
+        fprintf(stderr, "cannot open netlink socket, errno:%d, dsec:%s\n", errno, strerror(errno));
+        return false;
+    }
+    do_on_exit close_sock([sock]() { close(sock); });
+
+    struct
+    {
+        struct nlmsghdr hdr;
+        struct ndmsg msg;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg));
+    req.hdr.nlmsg_type = RTM_GETNEIGH;
+    req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.hdr.nlmsg_seq = 1;
+    req.msg.ndm_family = AF_INET;
+
+    if (send(sock, &req, req.hdr.nlmsg_len, 0) < 0)
+    {
+        fprintf(stderr, "cannot send netlink request, errno:%d, desc:%s\n", errno, strerror(errno));
+        return false;
+    }
+
+    std::vector<char> buf(64 * 1024);
+    while (true)
+    {
+        auto len = recv(sock, &buf[0], buf.size(), 0);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fprintf(stderr, "cannot recv netlink reply, errno:%d, desc:%s\n", errno, strerror(errno));
+            return false;
+        }
+
+        for (auto hdr = (struct nlmsghdr *)&buf[0]; NLMSG_OK(hdr, len); hdr = NLMSG_NEXT(hdr, len))
+        {
+            if (hdr->nlmsg_type == NLMSG_DONE)
+            {
+                return true;
+            }
+            if (hdr->nlmsg_type == NLMSG_ERROR)
+            {
+                auto err = (struct nlmsgerr *)NLMSG_DATA(hdr);
+                fprintf(stderr, "netlink dump failed, errno:%d, desc:%s\n", -err->error, strerror(-err->error));
+                return false;
+            }
+            if (hdr->nlmsg_type != RTM_NEWNEIGH)
+            {
+                continue;
+            }
+
+            auto msg = (struct ndmsg *)NLMSG_DATA(hdr);
+            if (msg->ndm_family != AF_INET || (ifindex != 0 && msg->ndm_ifindex != ifindex))
+            {
+                continue;
+            }
+
+            neigh_entry entry;
+            entry.ifindex = msg->ndm_ifindex;
+            entry.state = msg->ndm_state;
+            int attr_len = RTM_PAYLOAD(hdr);
+            for (auto attr = RTM_RTA(msg); RTA_OK(attr, attr_len); attr = RTA_NEXT(attr, attr_len))
+            {
+                if (attr->rta_type == NDA_DST && RTA_PAYLOAD(attr) == sizeof(uint32_t))
+                {
+                    memcpy(&entry.ip, RTA_DATA(attr), sizeof(uint32_t));
+                }
+                else if (attr->rta_type == NDA_LLADDR && RTA_PAYLOAD(attr) == ETH_ALEN)
+                {
+                    entry.mac = mac_to_str(mac_from_bytes((const unsigned char *)RTA_DATA(attr)));
+                }
+            }
+            if (entry.ip != 0)
+            {
+                neigh_vec.emplace_back(std::move(entry));
+            }
+        }
+    }
+}
+
+static bool get_interface_addr(const std::string &interface, uint32_t &ip, uint32_t &mask)
+{
+    struct ifaddrs *iflist;
+    if (getifaddrs(&iflist) < 0)
+    {
+        return false;
+    }
+
+    bool found = false;
+    for (auto ifa = iflist; ifa != nullptr && !found; ifa = ifa->ifa_next)
+    {
+        if (ifa->ifa_addr
+            && ifa->ifa_netmask
+            && ifa->ifa_addr->sa_family == AF_INET
+            && interface == ifa->ifa_name)
+        {
+            ip = ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr;
+            mask = ((struct sockaddr_in *)ifa->ifa_netmask)->sin_addr.s_addr;
+            found = true;
+        }
+    }
+
+    freeifaddrs(iflist);
+    return found;
+}
+
+// picks the up interface whose ipv4 network contains the subnet
+static std::string find_subnet_interface(const uint32_t network)
+{
+    for (auto &interface : get_interfaces())
+    {
+        uint32_t ip = 0;
+        uint32_t mask = 0;
+        if (get_interface_addr(interface, ip, mask) && (ip & mask) == (network & mask))
+        {
+            return interface;
+        }
+    }
+    return "";
+}
+
+/*
+   sends one arp request to every host of the subnet and collects the replies
+   while sending, the kernel only learns replies to requests it sent itself,
+   so the replies are merged with the neighbor dump by the caller
+*/
+static bool sweep_subnet(const std::string &interface,
+                         const uint32_t network,
+                         const uint32_t mask,
+                         const uint32_t wait_ms,
+                         std::map<uint32_t, std::string> &reply_map)
+{
+    uint32_t src_ip = 0;
+    uint32_t src_mask = 0;
+    if (!get_interface_addr(interface, src_ip, src_mask))
+    {
+        fprintf(stderr, "interface: %s has no ipv4 address\n", interface.c_str());
+        return false;
+    }
+
+    int sock = socket(AF_PACKET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, htons(ETH_P_ARP));
+    if (sock < 0)
+    {
+        fprintf(stderr, "cannot open packet socket, errno:%d, dsec:%s\n", errno, strerror(errno));
+        return false;
+    }
+    do_on_exit close_sock([sock]() { close(sock); });
+
+    struct ifreq req;
+    memset(&req, 0, sizeof(req));
+    strncpy(req.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+    if (ioctl(sock, SIOCGIFINDEX, &req) < 0)
+    {
+        fprintf(stderr, "cannot get interface: %s, errno:%d, dsec:%s\n", interface.c_str(), errno, strerror(errno));
+        return false;
+    }
+    int ifindex = req.ifr_ifindex;
+    if (ioctl(sock, SIOCGIFHWADDR, &req) < 0)
+    {
+        fprintf(stderr, "cannot get mac of interface: %s, errno:%d, dsec:%s\n", interface.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    struct sockaddr_ll addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sll_family = AF_PACKET;
+    addr.sll_protocol = htons(ETH_P_ARP);
+    addr.sll_ifindex = ifindex;
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        fprintf(stderr, "cannot bind packet socket, errno:%d, dsec:%s\n", errno, strerror(errno));
+        return false;
+    }
+    addr.sll_halen = ETH_ALEN;
+    memset(addr.sll_addr, 0xff, ETH_ALEN);
+
+    struct ether_arp request;
+    memset(&request, 0, sizeof(request));
+    request.arp_hrd = htons(ARPHRD_ETHER);
+    request.arp_pro = htons(ETH_P_IP);
+    request.arp_hln = ETH_ALEN;
+    request.arp_pln = sizeof(uint32_t);
+    request.arp_op = htons(ARPOP_REQUEST);
+    memcpy(request.arp_sha, req.ifr_hwaddr.sa_data, ETH_ALEN);
+    memcpy(request.arp_spa, &src_ip, sizeof(uint32_t));
+
+    auto recv_replies = [&]()
+    {
+        struct ether_arp reply;
+        while (recv(sock, &reply, sizeof(reply), 0) == sizeof(reply))
+        {
+            uint32_t ip = 0;
+            memcpy(&ip, reply.arp_spa, sizeof(uint32_t));
+            if (ntohs(reply.arp_op) == ARPOP_REPLY && (ip & mask) == network)
+            {
+                reply_map[ip] = mac_to_str(mac_from_bytes(reply.arp_sha));
+            }
+        }
+    };
+
+    // network and broadcast addresses are skipped unless the subnet is a /31 or /32
+    uint32_t first = ntohl(network);
+    uint32_t last = first | ~ntohl(mask);
+    if (last - first > 1)
+    {
+        ++first;
+        --last;
+    }
+
+    for (uint64_t host = first; host <= last; ++host)
+    {
+        uint32_t ip = htonl(static_cast<uint32_t>(host));
+        memcpy(request.arp_tpa, &ip, sizeof(uint32_t));
+        while (sendto(sock, &request, sizeof(request), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            if (errno != EAGAIN && errno != ENOBUFS)
+            {
+                fprintf(stderr, "cannot send arp request, errno:%d, desc:%s\n", errno, strerror(errno));
+                return false;
+            }
+
+            // the tx queue is full, take the replies off the rx queue meanwhile
+            recv_replies();
+            struct pollfd pfd = {sock, POLLOUT, 0};
+            poll(&pfd, 1, 1);
+        }
+        recv_replies();
+    }
+
+    auto deadline = now_ms() + wait_ms;
+    for (auto now = now_ms(); now < deadline; now = now_ms())
+    {
+        struct pollfd pfd = {sock, POLLIN, 0};
+        if (poll(&pfd, 1, deadline - now) > 0)
+        {
+            recv_replies();
+        }
+    }
+
+    return true;
+}
+
+struct name_lookup
+{
+    std::mutex mutex;
+    std::condition_variable done_cond;
+    std::vector<uint32_t> ip_vec;
+    std::vector<std::string> name_vec;
+    std::atomic<std::size_t> next_index{0};
+    std::size_t done_count = 0;
+};
+
+// reverse lookups for all ips at once, names not found within wait_ms stay empty,
+// a lookup still hanging after that finishes on its detached thread and is dropped
+static std::vector<std::string> lookup_names(const std::vector<uint32_t> &ip_vec, const uint32_t wait_ms)
+{
+    constexpr std::size_t kLookupThreads = 64;
+
+    auto lookup = std::make_shared<name_lookup>();
+    lookup->ip_vec = ip_vec;
+    lookup->name_vec.resize(ip_vec.size());
+
+    std::size_t thread_count = 0;
+    for (; thread_count < std::min(kLookupThreads, ip_vec.size()); ++thread_count)
+    {
+        try
+        {
+            std::thread([lookup]()
+            {
+                for (auto index = lookup->next_index++; index < lookup->ip_vec.size(); index = lookup->next_index++)
+                {
+                    struct sockaddr_in addr;
+                    memset(&addr, 0, sizeof(addr));
+                    addr.sin_family = AF_INET;
+                    addr.sin_addr.s_addr = lookup->ip_vec[index];
+                    char host[NI_MAXHOST];
+                    auto ret = getnameinfo((struct sockaddr *)&addr, sizeof(addr), host, sizeof(host), nullptr, 0, NI_NAMEREQD);
+
+                    std::lock_guard<std::mutex> lock(lookup->mutex);
+                    if (ret == 0)
+                    {
+                        lookup->name_vec[index] = host;
+                    }
+                    if (++lookup->done_count == lookup->ip_vec.size())
+                    {
+                        lookup->done_cond.notify_one();
+                    }
+                }
+            }).detach();
+        }
+        catch (const std::system_error &e)
+        {
+            fprintf(stderr, "cannot start name lookup thread, desc:%s\n", e.what());
+            break;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(lookup->mutex);
+    if (thread_count != 0
+        && !lookup->done_cond.wait_for(lock, std::chrono::milliseconds(wait_ms),
+                                       [&]() { return lookup->done_count == lookup->ip_vec.size(); }))
+    {
+        // the running lookups pick no new ips
+        lookup->next_index = lookup->ip_vec.size();
+        fprintf(stderr, "name lookup timed out after %ums, %zu of %zu ips resolved\n",
+                wait_ms, lookup->done_count, lookup->ip_vec.size());
+    }
+    return lookup->name_vec;
+}
+
+static bool discover_aliases(std::map<std::string, std::string> &cmd_map, int argc, char **argv)
+{
+    constexpr uint32_t kMinSweepPrefix = 16;
+    constexpr uint32_t kSweepWaitMs = 1000;
+    constexpr uint32_t kLookupWaitMs = 3000;
+
+    std::string subnet;
+    bool numeric = false;
+    std::regex reg("^(-{0,2})(.+)$");
+    for (int i = 0; i < argc; ++i)
+    {
+        std::string cmd = argv[i];
+        std::smatch match_result;
+        if (std::regex_match(cmd, match_result, reg) && !match_result[1].str().empty())
+        {
+            cmd = match_result[2];
+            if (cmd == "n" || cmd == "numeric")
+            {
+                numeric = true;
+                continue;
+            }
+            else if ((cmd == "i" || cmd == "interface") && i + 1 < argc)
+            {
+                cmd_map["interface"] = argv[++i];
+                continue;
+            }
+        }
+        else if (subnet.empty())
+        {
+            subnet = argv[i];
+            continue;
+        }
+
+        fprintf(stderr, "invalid discover option: %s\n", argv[i]);
+        return false;
+    }
+
+    uint32_t network = 0;
+    uint32_t mask = 0;
+    if (!subnet.empty() && !parse_subnet(subnet, network, mask))
+    {
+        fprintf(stderr, "invalid subnet: %s\n", subnet.c_str());
+        return false;
+    }
+
+    std::string interface;
+    int ifindex = 0;
+    auto it = cmd_map.find("interface");
+    if (it != cmd_map.end())
+    {
+        interface = it->second;
+        ifindex = if_nametoindex(interface.c_str());
+        if (ifindex == 0)
+        {
+            fprintf(stderr, "no interface: %s found\n", interface.c_str());
+            return false;
+        }
+    }
+
+    std::map<uint32_t, std::string> ip_mac_map;
+    if (!subnet.empty())
+    {
+        if (ntohl(~mask) >= (1u << (32 - kMinSweepPrefix)))
+        {
+            fprintf(stderr, "subnet: %s too large, the prefix must be at least /%u\n", subnet.c_str(), kMinSweepPrefix);
+            return false;
+        }
+        if (interface.empty())
+        {
+            interface = find_subnet_interface(network);
+            if (interface.empty())
+            {
+                fprintf(stderr, "no interface for subnet: %s found, use -i\n", subnet.c_str());
+                return false;
+            }
+        }
+
+        auto start = now_ms();
+        if (!sweep_subnet(interface, network, mask, kSweepWaitMs, ip_mac_map))
+        {
+            return false;
+        }
+        printf("swept %s by interface: %s, %zu replies in %llums\n",
+               subnet.c_str(), interface.c_str(), ip_mac_map.size(),
+               static_cast<unsigned long long>(now_ms() - start));
+    }
+
+    std::vector<neigh_entry> neigh_vec;
+    if (!dump_neighbors(ifindex, neigh_vec))
+    {
+        return false;
+    }
+    for (auto &entry : neigh_vec)
+    {
+        if (entry.mac.empty() || entry.mac == "00:00:00:00:00:00"
+            || (entry.state & (NUD_INCOMPLETE | NUD_FAILED | NUD_NOARP)))
+        {
+            continue;
+        }
+        if (subnet.empty() || (entry.ip & mask) == network)
+        {
+            ip_mac_map.emplace(entry.ip, std::move(entry.mac));
+        }
+    }
+
+    if (ip_mac_map.empty())
+    {
+        printf("no neighbors found\n");
+        return true;
+    }
+
+    file_helper file;
+    std::string data;
+    if (!file.open(s_stores_file_path, O_RDONLY | O_CREAT) || !file.read(data))
+    {
+        return false;
+    }
+    auto mac_addr_map = parse_mac_addr(data);
+
+    file_helper ip_file;
+    std::map<std::string, uint32_t> alias_ip_map;
+    if (!read_alias_ips(ip_file, alias_ip_map))
+    {
+        return false;
+    }
+
+    std::vector<std::string> name_vec;
+    if (!numeric)
+    {
+        std::vector<uint32_t> ip_vec;
+        for (auto &item : ip_mac_map)
         {
-            fprintf(stderr, "read open stores file failed\n");
+            ip_vec.emplace_back(item.first);
+        }
+        name_vec = lookup_names(ip_vec, kLookupWaitMs);
+    }
+
+    uint32_t added = 0;
+    uint32_t updated = 0;
+    bool ip_changed = false;
+    std::size_t index = 0;
+    for (auto &item : ip_mac_map)
+    {
+        auto alias = ip_to_str(item.first);
+        if (index < name_vec.size() && !name_vec[index].empty())
+        {
+            alias = name_vec[index];
+        }
+        ++index;
+
+        auto &last_ip = alias_ip_map[alias];
+        ip_changed = ip_changed || last_ip != item.first;
+        last_ip = item.first;
+
+        auto alias_it = mac_addr_map.find(alias);
+        if (alias_it == mac_addr_map.end())
+        {
+            ++added;
+            mac_addr_map.emplace(alias, item.second);
+        }
+        else if (strcasecmp(alias_it->second.c_str(), item.second.c_str()) != 0)
+        {
+            ++updated;
+            alias_it->second = item.second;
+        }
+        else
+        {
+            continue;
+        }
+        printf("    %s    %s    %s\n", item.second.c_str(), alias.c_str(), ip_to_str(item.first).c_str());
+    }
+
+    if (added + updated != 0 && !file.write_truncate_atomic(mac_addr_to_str(mac_addr_map)))
+    {
+        fprintf(stderr, "stores discovered aliases failed\n");
+        return false;
+    }
+    if (ip_changed && !ip_file.write_truncate_atomic(alias_ip_to_str(alias_ip_map)))
+    {
+        fprintf(stderr, "stores discovered ips failed\n");
+        return false;
+    }
+
+    printf("discovered %zu neighbors, %u aliases added, %u updated\n", ip_mac_map.size(), added, updated);
+    return true;
+}
+
+struct neigh_request
+{
+    int ifindex = 0;
+    uint32_t ip = 0;
+    unsigned char mac[ETH_ALEN];
+    uint16_t state = NUD_PERMANENT;
+    uint16_t flags = NLM_F_CREATE | NLM_F_EXCL; // RTM_NEWNEIGH only
+};
+
+// the last known ip of every target, by its alias or else by any alias with the same mac
+static bool resolve_unicast_ips(const std::map<std::string, std::string> &mac_addr_map,
+                                const std::vector<std::string> &target_alias_vec,
+                                const std::vector<std::string> &mac_addr_vec,
+                                std::vector<uint32_t> &dst_ip_vec)
+{
+    file_helper ip_file;
+    std::map<std::string, uint32_t> alias_ip_map;
+    if (!read_alias_ips(ip_file, alias_ip_map))
+    {
+        return false;
+    }
+
+    std::map<uint64_t, uint32_t> mac_ip_map;
+    for (auto &item : alias_ip_map)
+    {
+        auto mac_it = mac_addr_map.find(item.first);
+        if (mac_it != mac_addr_map.end())
+        {
+            mac_ip_map[mac_str_to_u64(mac_it->second)] = item.second;
+        }
+    }
+
+    for (std::size_t index = 0; index < mac_addr_vec.size(); ++index)
+    {
+        auto ip_it = alias_ip_map.find(target_alias_vec[index]);
+        if (ip_it != alias_ip_map.end())
+        {
+            dst_ip_vec[index] = ip_it->second;
+            continue;
+        }
+
+        auto mac_ip_it = mac_ip_map.find(mac_str_to_u64(mac_addr_vec[index]));
+        if (mac_ip_it == mac_ip_map.end())
+        {
+            fprintf(stderr, "no ip for: %s found, store one with wol ip or wol discover\n", mac_addr_vec[index].c_str());
             return false;
         }
+        dst_ip_vec[index] = mac_ip_it->second;
     }
 
-    auto mac_addr_map = parse_mac_addr(data);
-    it = cmd_map.find("wake");
-    if (it != cmd_map.end())
+    return true;
+}
+
+/*
+   adds (RTM_NEWNEIGH) or deletes (RTM_DELNEIGH) neighbor entries, packing up
+   to 256 requests into each netlink send and then reading their acks, done_vec
+   marks the requests the kernel acked without error as the acks come in
+*/
+static bool update_neighbors(const std::vector<neigh_request> &neigh_vec,
+                             const uint16_t msg_type,
+                             std::vector<bool> &done_vec)
+{
+    constexpr uint32_t kBatchSize = 256;
+
+    struct neigh_msg
     {
-        wake_machine_vec.emplace_back(it->second);
+        struct nlmsghdr hdr;
+        struct ndmsg msg;
+        char attrs[RTA_SPACE(sizeof(uint32_t)) + RTA_SPACE(ETH_ALEN)];
+    };
+
+    int sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock < 0)
+    {
+        fprintf(stderr, "cannot open netlink socket, errno:%d, dsec:%s\n", errno, strerror(errno));
+        return false;
     }
+    do_on_exit close_sock([sock]() { close(sock); });
 
-    std::vector<std::string> mac_addr_vec;
-    for (auto &mac_addr : wake_machine_vec)
+    done_vec.assign(neigh_vec.size(), false);
+    bool ok = true;
+    std::vector<neigh_msg> msg_vec;
+    std::vector<char> buf(64 * 1024);
+    for (std::size_t start = 0; start < neigh_vec.size(); start += kBatchSize)
     {
-        std::regex reg(s_reg_str);
-        if (std::regex_match(mac_addr, reg))
+        auto end = std::min<std::size_t>(start + kBatchSize, neigh_vec.size());
+        msg_vec.assign(end - start, neigh_msg());
+        for (auto index = start; index < end; ++index)
         {
-            std::replace(mac_addr.begin(), mac_addr.begin(), '-', ':');
-            mac_addr_vec.emplace_back(std::move(mac_addr));
+            auto &req = msg_vec[index - start];
+            auto &neigh = neigh_vec[index];
+            memset(&req, 0, sizeof(req));
+            req.hdr.nlmsg_len = sizeof(req);
+            req.hdr.nlmsg_type = msg_type;
+            req.hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+            if (msg_type == RTM_NEWNEIGH)
+            {
+                req.hdr.nlmsg_flags |= neigh.flags;
+            }
+            req.hdr.nlmsg_seq = index + 1;
+            req.msg.ndm_family = AF_INET;
+            req.msg.ndm_ifindex = neigh.ifindex;
+            req.msg.ndm_state = neigh.state;
+
+            auto attr = (struct rtattr *)req.attrs;
+            attr->rta_type = NDA_DST;
+            attr->rta_len = RTA_LENGTH(sizeof(uint32_t));
+            memcpy(RTA_DATA(attr), &neigh.ip, sizeof(uint32_t));
+            attr = (struct rtattr *)(req.attrs + RTA_SPACE(sizeof(uint32_t)));
+            attr->rta_type = NDA_LLADDR;
+            attr->rta_len = RTA_LENGTH(ETH_ALEN);
+            memcpy(RTA_DATA(attr), neigh.mac, ETH_ALEN);
         }
-        else
+
+        if (send(sock, &msg_vec[0], msg_vec.size() * sizeof(neigh_msg), 0) < 0)
         {
-            auto addr_it = mac_addr_map.find(mac_addr);
-            if (addr_it == mac_addr_map.end())
+            fprintf(stderr, "cannot send netlink request, errno:%d, desc:%s\n", errno, strerror(errno));
+            return false;
+        }
+
+        auto acks = start;
+        while (acks < end)
+        {
+            auto len = recv(sock, &buf[0], buf.size(), 0);
+            if (len < 0)
             {
-                fprintf(stderr, "no aliase: %s found\n", mac_addr.c_str());
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                fprintf(stderr, "cannot recv netlink reply, errno:%d, desc:%s\n", errno, strerror(errno));
                 return false;
             }
 
-            std::replace(addr_it->second.begin(), addr_it->second.begin(), '-', ':');
-            mac_addr_vec.emplace_back(addr_it->second);
+            for (auto hdr = (struct nlmsghdr *)&buf[0]; NLMSG_OK(hdr, len); hdr = NLMSG_NEXT(hdr, len))
+            {
+                if (hdr->nlmsg_type != NLMSG_ERROR)
+                {
+                    continue;
+                }
+
+                ++acks;
+                auto err = (struct nlmsgerr *)NLMSG_DATA(hdr);
+                if (err->error != 0 && !(msg_type == RTM_DELNEIGH && err->error == -ENOENT))
+                {
+                    auto &neigh = neigh_vec[hdr->nlmsg_seq - 1];
+                    fprintf(stderr, "%s neighbor: %s failed, errno:%d, desc:%s\n",
+                            msg_type == RTM_NEWNEIGH ? "add" : "delete",
+                            ip_to_str(neigh.ip).c_str(), -err->error, strerror(-err->error));
+                    ok = false;
+                    continue;
+                }
+                done_vec[hdr->nlmsg_seq - 1] = true;
+            }
         }
     }
 
-    for (auto &mac_addr : mac_addr_vec)
+    return ok;
+}
+
+/*
+   picks the neighbor entries to add so that no target needs arp, targets the
+   kernel already knows with the right mac and targets off the local subnets
+   are left alone. new entries are created with NLM_F_EXCL, entries the kernel
+   knows with another mac are replaced and old_vec holds what to put back for
+   them, for every other add old_vec holds a zero state: delete it afterwards
+*/
+static bool plan_neighbors(const std::string &interface,
+                           const std::vector<std::string> &mac_addr_vec,
+                           const std::vector<uint32_t> &dst_ip_vec,
+                           std::vector<neigh_request> &neigh_vec,
+                           std::vector<neigh_request> &old_vec)
+{
+    struct local_subnet
     {
-        auto packet = package_magic_data(mac_addr);
-        for (auto &interface : interface_set)
+        int ifindex;
+        uint32_t network;
+        uint32_t mask;
+    };
+
+    std::vector<local_subnet> subnet_vec;
+    std::set<std::string> interface_set;
+    if (!interface.empty())
+    {
+        interface_set.emplace(interface);
+    }
+    else
+    {
+        interface_set = get_interfaces();
+    }
+    for (auto &name : interface_set)
+    {
+        uint32_t ip = 0;
+        uint32_t mask = 0;
+        int ifindex = if_nametoindex(name.c_str());
+        if (ifindex != 0 && get_interface_addr(name, ip, mask))
+        {
+            subnet_vec.push_back({ifindex, ip & mask, mask});
+        }
+    }
+
+    std::vector<neigh_entry> known_vec;
+    if (!dump_neighbors(0, known_vec))
+    {
+        return false;
+    }
+    // keyed by ifindex << 32 | ip, the same ip may be known on several interfaces
+    std::unordered_map<uint64_t, const neigh_entry *> known_map;
+    for (auto &entry : known_vec)
+    {
+        known_map[static_cast<uint64_t>(entry.ifindex) << 32 | entry.ip] = &entry;
+    }
+
+    std::unordered_set<uint64_t> planned_set;
+    for (std::size_t index = 0; index < mac_addr_vec.size(); ++index)
+    {
+        auto ip = dst_ip_vec[index];
+        auto mac = mac_str_to_u64(mac_addr_vec[index]);
+
+        auto subnet_it = std::find_if(subnet_vec.begin(), subnet_vec.end(), [ip](const local_subnet &subnet)
+        {
+            return (ip & subnet.mask) == subnet.network;
+        });
+        if (subnet_it == subnet_vec.end())
         {
-            int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-            if (sock  < 0 )
+            fprintf(stderr, "ip: %s is not on a local subnet, sent without a neighbor entry\n", ip_to_str(ip).c_str());
+            continue;
+        }
+
+        auto key = static_cast<uint64_t>(subnet_it->ifindex) << 32 | ip;
+        if (!planned_set.emplace(key).second)
+        {
+            continue;
+        }
+
+        neigh_request neigh;
+        neigh.ifindex = subnet_it->ifindex;
+        neigh.ip = ip;
+        mac_to_bytes(mac, neigh.mac);
+
+        neigh_request old;
+        old.ifindex = neigh.ifindex;
+        old.ip = ip;
+        old.state = 0;
+        auto known_it = known_map.find(key);
+        if (known_it != known_map.end())
+        {
+            auto &known = *known_it->second;
+            if (known.state & NUD_NOARP)
             {
-                fprintf(stderr, "cannot open socket, errno:%d, dsec:%s\n", errno, strerror(errno));
-                return false;
+                continue;
             }
-
-            int optval = 1;
-            if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (char *) &optval, sizeof(optval)) < 0)
+            if (known.state != NUD_NONE && !(known.state & (NUD_INCOMPLETE | NUD_FAILED)) && !known.mac.empty())
             {
-                fprintf(stderr, "cannot set socket options, errno:%d, desc:%s\n", errno, strerror(errno));
-                return false;
+                if (mac_str_to_u64(known.mac) == mac)
+                {
+                    continue;
+                }
+                // put the old mac back afterwards, as stale unless it was permanent
+                // so the kernel checks it again
+                mac_to_bytes(mac_str_to_u64(known.mac), old.mac);
+                old.state = (known.state & NUD_PERMANENT) ? NUD_PERMANENT : NUD_STALE;
+                old.flags = NLM_F_CREATE | NLM_F_REPLACE;
             }
+            // an incomplete or failed entry is replaced and deleted afterwards
+            neigh.flags = NLM_F_CREATE | NLM_F_REPLACE;
+        }
 
-            struct ifreq req;
-            memset(&req, 0, sizeof(req));
-            strncpy(req.ifr_name, interface.c_str(), IFNAMSIZ);
-            ioctl(sock, SIOCGIFINDEX, &req);
+        neigh_vec.emplace_back(neigh);
+        old_vec.emplace_back(old);
+    }
+
+    return true;
+}
+
+static bool send_unicast(const std::string &interface,
+                         const bool keep_neigh,
+                         const std::vector<std::string> &mac_addr_vec,
+                         const std::vector<uint32_t> &dst_ip_vec,
+                         const std::vector<std::vector<unsigned char>> &packet_vec,
+                         const std::vector<uint16_t> &port_vec,
+                         const uint32_t repeat,
+                         const uint32_t gap_us)
+{
+    std::vector<neigh_request> neigh_vec;
+    std::vector<neigh_request> old_vec;
+    if (!plan_neighbors(interface, mac_addr_vec, dst_ip_vec, neigh_vec, old_vec))
+    {
+        return false;
+    }
 
-            struct sockaddr_in addr;
-            memset(&addr, 0, sizeof(addr));
-            addr.sin_family = AF_INET;
-            addr.sin_port = htons(port);
-            if (inet_aton(bcast_addr.c_str(), &addr.sin_addr) == 0)
+    // once the packets are out, entries we created go away again and entries
+    // we replaced get their old mac back, even with keep_neigh. only the adds
+    // the kernel acked are undone, whatever else happened
+    std::vector<bool> added_vec;
+    do_on_exit remove_neighs([&]()
+    {
+        std::vector<neigh_request> delete_vec;
+        std::vector<neigh_request> restore_vec;
+        for (std::size_t index = 0; index < added_vec.size(); ++index)
+        {
+            if (!added_vec[index])
             {
-                fprintf(stderr, "Invalid remote ip address given: %s\n", bcast_addr.c_str());
-                return false;
+                continue;
             }
-
-            if (sendto(sock, &packet[0], packet.size(), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            if (old_vec[index].state != 0)
             {
-                fprintf(stderr, "cannot send data, errno:%d,  desc:%s\n", errno, strerror(errno));
-                return false;
+                restore_vec.emplace_back(old_vec[index]);
             }
+            else if (!keep_neigh)
+            {
+                delete_vec.emplace_back(neigh_vec[index]);
+            }
+        }
+
+        std::vector<bool> done_vec;
+        update_neighbors(delete_vec, RTM_DELNEIGH, done_vec);
+        update_neighbors(restore_vec, RTM_NEWNEIGH, done_vec);
+    });
+
+    // a failed add only costs that target its entry, update_neighbors logged it
+    // and the packet still goes out, needing arp like any other unicast
+    if (!update_neighbors(neigh_vec, RTM_NEWNEIGH, added_vec))
+    {
+        fprintf(stderr, "some neighbor entries were not added, sending to all targets anyway\n");
+    }
+    std::size_t kept_count = 0;
+    for (std::size_t index = 0; index < added_vec.size(); ++index)
+    {
+        kept_count += added_vec[index] && old_vec[index].state == 0 ? 1 : 0;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock  < 0 )
+    {
+        fprintf(stderr, "cannot open socket, errno:%d, dsec:%s\n", errno, strerror(errno));
+        return false;
+    }
+    do_on_exit close_sock([sock]() { close(sock); });
+
+    if (!interface.empty()
+        && setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, interface.c_str(), interface.size()) < 0)
+    {
+        fprintf(stderr, "cannot bind to interface: %s, errno:%d, desc:%s\n", interface.c_str(), errno, strerror(errno));
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    for (uint32_t round = 0; round < repeat; ++round)
+    {
+        if (round != 0 && gap_us != 0)
+        {
+            usleep(gap_us);
+        }
 
-            printf("Successful sent WOL magic packet to: %s by interface: %s\n", mac_addr.c_str(), interface.c_str());
+        for (std::size_t index = 0; index < packet_vec.size(); ++index)
+        {
+            addr.sin_addr.s_addr = dst_ip_vec[index];
+            for (auto port : port_vec)
+            {
+                addr.sin_port = htons(port);
+                if (sendto(sock, &packet_vec[index][0], packet_vec[index].size(), 0, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+                {
+                    fprintf(stderr, "cannot send data to: %s, errno:%d,  desc:%s\n", ip_to_str(dst_ip_vec[index]).c_str(), errno, strerror(errno));
+                    return false;
+                }
+            }
         }
     }
 
+    for (std::size_t index = 0; index < mac_addr_vec.size(); ++index)
+    {
+        printf("Successful sent %u WOL magic packets to: %s by unicast ip: %s\n",
+               repeat, mac_addr_vec[index].c_str(), ip_to_str(dst_ip_vec[index]).c_str());
+    }
+    if (keep_neigh && kept_count != 0)
+    {
+        printf("kept %zu permanent neighbor entries\n", kept_count);
+    }
+
     return true;
 }
 
@@ -742,6 +3473,11 @@ bool file_helper::write_truncate_atomic(const std::string &new_data)
         {
             break;
         }
+        if (errno != EEXIST)
+        {
+            return false;
+        }
+        ++i;
     }
     
     if (!write_tmp_file.write(new_data))
@@ -770,6 +3506,136 @@ bool file_helper::write_truncate_atomic(const std::string &new_data)
     return true;
 }
 
+bool pcap_writer::open(const std::string &file_name, const bool use_mmap)
+{
+    constexpr uint32_t kPcapMagic = 0xa1b2c3d4;
+    constexpr uint32_t kSnapLen = 65535;
+    constexpr uint32_t kLinkTypeEthernet = 1;
+
+    if (!file_.open(file_name, O_RDWR | O_CREAT | O_TRUNC))
+    {
+        return false;
+    }
+
+    use_mmap_ = use_mmap;
+    closed_ = false;
+    buffer_.reserve(kPcapBufferSize);
+
+    // the global header, native byte order as the magic tells readers
+    uint32_t header[6] = {kPcapMagic, 2 | (4 << 16), 0, 0, kSnapLen, kLinkTypeEthernet};
+    if (use_mmap_)
+    {
+        if (!remap(sizeof(header)))
+        {
+            return false;
+        }
+        memcpy(map_data_, header, sizeof(header));
+        map_pos_ = sizeof(header);
+    }
+    else
+    {
+        buffer_.append((const char *)header, sizeof(header));
+    }
+
+    return true;
+}
+
+bool pcap_writer::write(const uint64_t ts_us, const unsigned char *frame, const uint32_t frame_size)
+{
+    uint32_t record[4] = {static_cast<uint32_t>(ts_us / 1000000), static_cast<uint32_t>(ts_us % 1000000), frame_size, frame_size};
+    ++frames_;
+
+    if (use_mmap_)
+    {
+        if (map_pos_ + sizeof(record) + frame_size > map_size_
+            && !remap(map_pos_ + sizeof(record) + frame_size))
+        {
+            return false;
+        }
+        memcpy(map_data_ + map_pos_, record, sizeof(record));
+        memcpy(map_data_ + map_pos_ + sizeof(record), frame, frame_size);
+        map_pos_ += sizeof(record) + frame_size;
+        return true;
+    }
+
+    buffer_.append((const char *)record, sizeof(record));
+    buffer_.append((const char *)frame, frame_size);
+    return buffer_.size() < kPcapBufferSize || flush();
+}
+
+bool pcap_writer::flush()
+{
+    if (!file_.write(buffer_))
+    {
+        return false;
+    }
+    buffer_.clear();
+    return true;
+}
+
+bool pcap_writer::remap(const std::size_t need_size)
+{
+    auto new_size = map_size_;
+    while (new_size < need_size)
+    {
+        new_size += kPcapMapChunkSize;
+    }
+
+    if (map_data_ != nullptr)
+    {
+        munmap(map_data_, map_size_);
+        map_data_ = nullptr;
+    }
+    if (ftruncate(file_.fd(), new_size) != 0)
+    {
+        fprintf(stderr, "ftruncate file failed, errno:%d, dsec:%s\n", errno, strerror(errno));
+        return false;
+    }
+
+    auto data = mmap(nullptr, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_.fd(), 0);
+    if (data == MAP_FAILED)
+    {
+        fprintf(stderr, "mmap file failed, errno:%d, dsec:%s\n", errno, strerror(errno));
+        return false;
+    }
+
+    map_data_ = (char *)data;
+    map_size_ = new_size;
+    return true;
+}
+
+bool pcap_writer::close()
+{
+    if (closed_)
+    {
+        return true;
+    }
+    closed_ = true;
+
+    if (!use_mmap_)
+    {
+        return flush();
+    }
+
+    if (map_data_ != nullptr)
+    {
+        munmap(map_data_, map_size_);
+        map_data_ = nullptr;
+    }
+    // drop the unused tail of the last chunk
+    if (ftruncate(file_.fd(), map_pos_) != 0)
+    {
+        fprintf(stderr, "ftruncate file failed, errno:%d, dsec:%s\n", errno, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+pcap_writer::~pcap_writer()
+{
+    close();
+}
+
 file_helper::~file_helper()
 {
     if (fd_ > 0)